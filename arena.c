@@ -0,0 +1,101 @@
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "memtracker.h"
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_ALIGN alignof(max_align_t)
+
+struct ArenaChunk {
+  ArenaChunk *next;
+  alignas(max_align_t) char data[];
+};
+
+static size_t align_up(size_t size) {
+  return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+static void arena_grow(Arena *arena, size_t size) {
+  size_t dataSize = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+  ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + dataSize);
+  if (!chunk) {
+    fprintf(stderr, "Arena out of memory\n");
+    abort();
+  }
+  chunk->next = arena->chunks;
+  arena->chunks = chunk;
+  arena->ptr = chunk->data;
+  arena->end = chunk->data + dataSize;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+  size = align_up(size ? size : 1);
+  if ((size_t)(arena->end - arena->ptr) < size) {
+    arena_grow(arena, size);
+  }
+  void *ptr = arena->ptr;
+  arena->ptr += size;
+  arena->last = ptr;
+  return ptr;
+}
+
+void *arena_calloc(Arena *arena, size_t count, size_t size) {
+  void *ptr = arena_alloc(arena, count * size);
+  memset(ptr, 0, count * size);
+  return ptr;
+}
+
+void *arena_realloc(Arena *arena, void *ptr, size_t oldSize, size_t newSize) {
+  if (!ptr) {
+    return arena_alloc(arena, newSize);
+  }
+  if (ptr == arena->last &&
+      (size_t)(arena->end - (char *)ptr) >= align_up(newSize)) {
+    arena->ptr = (char *)ptr + align_up(newSize);
+    return ptr;
+  }
+  if (newSize <= oldSize) {
+    return ptr;
+  }
+  void *newPtr = arena_alloc(arena, newSize);
+  memcpy(newPtr, ptr, oldSize);
+  return newPtr;
+}
+
+char *arena_strdup(Arena *arena, const char *str) {
+  size_t len = strlen(str);
+  char *out = arena_alloc(arena, len + 1);
+  memcpy(out, str, len + 1);
+  return out;
+}
+
+void arena_free(Arena *arena) {
+  ArenaChunk *chunk = arena->chunks;
+  while (chunk) {
+    ArenaChunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  *arena = (Arena){0};
+}
+
+void arena_reset(Arena *arena) {
+  ArenaChunk *kept = arena->chunks;
+  if (!kept) {
+    return;
+  }
+  ArenaChunk *chunk = kept->next;
+  while (chunk) {
+    ArenaChunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  kept->next = NULL;
+  arena->ptr = kept->data;
+  arena->last = NULL;
+}
@@ -0,0 +1,31 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <stddef.h>
+
+typedef struct ArenaChunk ArenaChunk;
+
+// Bump allocator for everything that lives as long as one compilation.
+// Individual allocations are never freed; arena_free releases them all.
+typedef struct {
+  ArenaChunk *chunks;
+  char *ptr;
+  char *end;
+  void *last;
+} Arena;
+
+void *arena_alloc(Arena *arena, size_t size);
+
+void *arena_calloc(Arena *arena, size_t count, size_t size);
+
+// Grows the most recent allocation in place when possible, otherwise copies.
+void *arena_realloc(Arena *arena, void *ptr, size_t oldSize, size_t newSize);
+
+char *arena_strdup(Arena *arena, const char *str);
+
+void arena_free(Arena *arena);
+
+// Drops every allocation but keeps the current chunk, so an arena reused
+// across many small compilations stops going back to malloc.
+void arena_reset(Arena *arena);
+
+#endif
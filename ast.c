@@ -0,0 +1,503 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "ast.h"
+#include "intern.h"
+#include "memtracker.h"
+#include "type.h"
+
+#define AST_MIN_CAPACITY 64
+
+// Bytes one node takes across the per-node arrays.
+#define NODE_SIZE (2 * sizeof(uint8_t) + 2 * sizeof(uint32_t) + sizeof(uint8_t))
+
+// The node arrays share one allocation and grow together.
+static void grow_nodes(Ast *ast, Arena *arena) {
+  NodeId capacity = ast->capacity ? ast->capacity * 2 : AST_MIN_CAPACITY;
+  char *block = arena_alloc(arena, (size_t)capacity * NODE_SIZE);
+  uint32_t *lhs = (uint32_t *)block;
+  uint32_t *rhs = lhs + capacity;
+  uint8_t *kinds = (uint8_t *)(rhs + capacity);
+  uint8_t *ops = kinds + capacity;
+  uint8_t *types = ops + capacity;
+  if (ast->count) {
+    memcpy(lhs, ast->lhs, ast->count * sizeof(uint32_t));
+    memcpy(rhs, ast->rhs, ast->count * sizeof(uint32_t));
+    memcpy(kinds, ast->kinds, ast->count);
+    memcpy(ops, ast->ops, ast->count);
+    memcpy(types, ast->types, ast->count);
+  }
+  *ast = (Ast){.kinds = kinds,
+               .ops = ops,
+               .lhs = lhs,
+               .rhs = rhs,
+               .types = types,
+               .count = ast->count,
+               .capacity = capacity,
+               .extra = ast->extra,
+               .extraCount = ast->extraCount,
+               .extraCapacity = ast->extraCapacity,
+               .literals = ast->literals,
+               .literalCount = ast->literalCount,
+               .literalCapacity = ast->literalCapacity,
+               .shared = ast->shared};
+}
+
+static NodeId add_node(Ast *ast, NodeKind kind, uint8_t op, uint32_t lhs,
+                       uint32_t rhs, Arena *arena) {
+  if (ast->count == ast->capacity) {
+    grow_nodes(ast, arena);
+  }
+  NodeId node = ast->count++;
+  ast->kinds[node] = kind;
+  ast->ops[node] = op;
+  ast->lhs[node] = lhs;
+  ast->rhs[node] = rhs;
+  ast->types[node] = TYPE_NULL;
+  return node;
+}
+
+// Reserves length entries of extra and returns the index of the first.
+static uint32_t add_extra(Ast *ast, uint32_t length, Arena *arena) {
+  if (ast->extraCount + length > ast->extraCapacity) {
+    uint32_t capacity = ast->extraCapacity ? ast->extraCapacity * 2
+                                           : AST_MIN_CAPACITY;
+    while (capacity < ast->extraCount + length) {
+      capacity *= 2;
+    }
+    ast->extra = arena_realloc(arena, ast->extra,
+                               ast->extraCapacity * sizeof(uint32_t),
+                               capacity * sizeof(uint32_t));
+    ast->extraCapacity = capacity;
+  }
+  uint32_t begin = ast->extraCount;
+  ast->extraCount += length;
+  return begin;
+}
+
+uint32_t ast_add_literal(Ast *ast, uint64_t bits, Arena *arena) {
+  if (ast->literalCount == ast->literalCapacity) {
+    uint32_t capacity = ast->literalCapacity ? ast->literalCapacity * 2 : 16;
+    ast->literals = arena_realloc(arena, ast->literals,
+                                  ast->literalCapacity * sizeof(uint64_t),
+                                  capacity * sizeof(uint64_t));
+    ast->literalCapacity = capacity;
+  }
+  ast->literals[ast->literalCount] = bits;
+  return ast->literalCount++;
+}
+
+// A function whose arguments names in its body can bind to.
+typedef struct {
+  FuncExpr *func;
+  uint8_t *types; // declared type of each argument
+} Frame;
+
+// Node already built for an operation or call that parse_shared shared.
+typedef struct {
+  const void *node; // NULL when empty
+  NodeId id;
+} Built;
+
+typedef struct {
+  Ast *ast;
+  Arena *arena;
+  bool shared;
+  Frame *frames;
+  int depth;
+  int frameCapacity;
+  Built *built;
+  size_t builtCount;
+  size_t builtCapacity; // always a power of two
+} Builder;
+
+static size_t hash_built(const void *node) {
+  uint64_t x = (uint64_t)(uintptr_t)node;
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  return (size_t)x;
+}
+
+static Built *find_built(Builder *b, const void *node) {
+  if ((b->builtCount + 1) * 2 > b->builtCapacity) {
+    size_t capacity = b->builtCapacity ? b->builtCapacity * 2 : 64;
+    Built *built = arena_calloc(b->arena, capacity, sizeof(Built));
+    for (size_t i = 0; i < b->builtCapacity; i++) {
+      if (b->built[i].node) {
+        size_t slot = hash_built(b->built[i].node) & (capacity - 1);
+        while (built[slot].node) {
+          slot = (slot + 1) & (capacity - 1);
+        }
+        built[slot] = b->built[i];
+      }
+    }
+    b->built = built;
+    b->builtCapacity = capacity;
+  }
+  size_t mask = b->builtCapacity - 1;
+  size_t slot = hash_built(node) & mask;
+  while (b->built[slot].node && b->built[slot].node != node) {
+    slot = (slot + 1) & mask;
+  }
+  return &b->built[slot];
+}
+
+// Same rule as the scopes annotate_types builds: the innermost function
+// wins, and within one the last argument of a name.
+static uint32_t bind_name(Builder *b, Atom name, uint8_t *type) {
+  for (int up = 0; up < b->depth; up++) {
+    Frame *frame = &b->frames[b->depth - 1 - up];
+    for (int i = frame->func->argc - 1; i >= 0; i--) {
+      if (frame->func->args[i].name == name) {
+        *type = frame->types[i];
+        return BINDING(up, i);
+      }
+    }
+  }
+  *type = TYPE_NULL;
+  return NODE_NONE;
+}
+
+// Builds a node that has no children.
+static NodeId build_leaf(Builder *b, Expr expr) {
+  Ast *ast = b->ast;
+  switch (expr.type) {
+  case EXPR_INT:
+    return add_node(ast, NODE_INT, 0, (uint32_t)expr.value._int, 0, b->arena);
+  case EXPR_FLOAT: {
+    uint32_t bits;
+    memcpy(&bits, &expr.value._float, sizeof(bits));
+    return add_node(ast, NODE_FLOAT, 0, bits, 0, b->arena);
+  }
+  case EXPR_LONG:
+    return add_node(ast, NODE_LONG, 0,
+                    ast_add_literal(ast, (uint64_t)expr.value._long, b->arena),
+                    0, b->arena);
+  case EXPR_DOUBLE: {
+    uint64_t bits;
+    memcpy(&bits, &expr.value._double, sizeof(bits));
+    return add_node(ast, NODE_DOUBLE, 0, ast_add_literal(ast, bits, b->arena),
+                    0, b->arena);
+  }
+  case EXPR_NAME: {
+    uint8_t type;
+    uint32_t binding = bind_name(b, expr.value.name, &type);
+    return add_node(ast, NODE_NAME, type, expr.value.name, binding, b->arena);
+  }
+  default:
+    return add_node(ast, NODE_NULL, 0, 0, 0, b->arena);
+  }
+}
+
+static void push_frame(Builder *b, FuncExpr *func) {
+  if (b->depth == b->frameCapacity) {
+    int capacity = b->frameCapacity ? b->frameCapacity * 2 : 8;
+    b->frames = arena_realloc(b->arena, b->frames,
+                              b->frameCapacity * sizeof(Frame),
+                              capacity * sizeof(Frame));
+    b->frameCapacity = capacity;
+  }
+  Frame *frame = &b->frames[b->depth++];
+  *frame = (Frame){.func = func,
+                   .types = arena_alloc(b->arena, func->argc + 1)};
+  for (int i = 0; i < func->argc; i++) {
+    frame->types[i] = parse_type(func->args[i].type).type;
+  }
+}
+
+// An operation, call, block or function whose children are being built.
+typedef struct {
+  Expr expr;
+  int next;      // index of the next child to build
+  NodeId first;  // left operand, callee or body once built
+  NodeId second; // right operand
+  uint32_t list; // extra list of a call or block
+} Task;
+
+static int child_count(Expr expr) {
+  switch (expr.type) {
+  case EXPR_OP:
+    return 2;
+  case EXPR_CALL:
+    return 1 + expr.value.call->argc;
+  case EXPR_BLOCK:
+    return expr.value.block->stmtc;
+  case EXPR_FUNC:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static Expr child(Expr expr, int i) {
+  switch (expr.type) {
+  case EXPR_OP:
+    return i ? expr.value.op->right : expr.value.op->left;
+  case EXPR_CALL:
+    return i ? expr.value.call->args[i - 1] : expr.value.call->func;
+  case EXPR_BLOCK:
+    return expr.value.block->stmts[i];
+  default:
+    return expr.value.func->body;
+  }
+}
+
+// Stores a built child where its parent's node will look for it.
+static void take_child(Ast *ast, Task *task, NodeId node) {
+  int i = task->next - 1;
+  if (i == 0 && task->expr.type != EXPR_BLOCK) {
+    task->first = node;
+  } else if (task->expr.type == EXPR_OP) {
+    task->second = node;
+  } else if (task->expr.type == EXPR_CALL) {
+    ast->extra[task->list + i] = node;
+  } else {
+    ast->extra[task->list + 1 + i] = node;
+  }
+}
+
+// Adds the node of a task whose children are all built.
+static NodeId finish(Builder *b, Task *task) {
+  Ast *ast = b->ast;
+  Expr expr = task->expr;
+  switch (expr.type) {
+  case EXPR_OP:
+    return add_node(ast, NODE_OP, expr.value.op->op, task->first, task->second,
+                    b->arena);
+  case EXPR_CALL:
+    return add_node(ast, NODE_CALL, 0, task->first, task->list, b->arena);
+  case EXPR_BLOCK:
+    return add_node(ast, NODE_BLOCK, expr.value.block->returns, task->list, 0,
+                    b->arena);
+  default: {
+    FuncExpr *func = expr.value.func;
+    b->depth--;
+    uint32_t list = add_extra(ast, 2 * func->argc + 1, b->arena);
+    ast->extra[list] = func->argc;
+    for (int i = 0; i < func->argc; i++) {
+      ast->extra[list + 1 + 2 * i] = func->args[i].name;
+      ast->extra[list + 2 + 2 * i] = func->args[i].type;
+    }
+    return add_node(ast, NODE_FUNC, 0, task->first, list, b->arena);
+  }
+  }
+}
+
+void ast_build(Ast *ast, Expr expr, bool shared, Arena *arena) {
+  *ast = (Ast){.shared = shared};
+  Builder b = {.ast = ast, .arena = arena, .shared = shared};
+  // an explicit stack rather than recursion, so deep trees can't overflow
+  // the C stack
+  Task *tasks = NULL;
+  int taskCount = 0, taskCapacity = 0;
+  Expr pending = expr;
+  bool descend = true;
+  NodeId built = NODE_NONE;
+  for (;;) {
+    if (descend) {
+      descend = false;
+      bool cached = false;
+      built = NODE_NONE;
+      if (shared && (pending.type == EXPR_OP || pending.type == EXPR_CALL)) {
+        Built *entry = find_built(&b, pending.value.op);
+        cached = entry->node != NULL;
+        built = cached ? entry->id : NODE_NONE;
+      }
+      if (!cached && child_count(pending) == 0 &&
+          pending.type != EXPR_BLOCK) {
+        built = build_leaf(&b, pending);
+      } else if (!cached) {
+        if (taskCount == taskCapacity) {
+          int capacity = taskCapacity ? taskCapacity * 2 : 64;
+          tasks = arena_realloc(arena, tasks, taskCapacity * sizeof(Task),
+                                capacity * sizeof(Task));
+          taskCapacity = capacity;
+        }
+        Task *task = &tasks[taskCount++];
+        *task = (Task){.expr = pending};
+        if (pending.type == EXPR_CALL || pending.type == EXPR_BLOCK) {
+          int length = child_count(pending) + (pending.type == EXPR_BLOCK);
+          task->list = add_extra(ast, (uint32_t)length, arena);
+          ast->extra[task->list] =
+              pending.type == EXPR_CALL ? (uint32_t)pending.value.call->argc
+                                        : (uint32_t)pending.value.block->stmtc;
+        } else if (pending.type == EXPR_FUNC) {
+          push_frame(&b, pending.value.func);
+        }
+      }
+    }
+    // hand the node just built to its parent, then descend into the
+    // parent's next child or finish it
+    while (!descend) {
+      if (taskCount == 0) {
+        return;
+      }
+      Task *task = &tasks[taskCount - 1];
+      if (built != NODE_NONE) {
+        take_child(ast, task, built);
+        built = NODE_NONE;
+      }
+      if (task->next < child_count(task->expr)) {
+        pending = child(task->expr, task->next++);
+        descend = true;
+        break;
+      }
+      built = finish(&b, task);
+      taskCount--;
+      if (shared && (task->expr.type == EXPR_OP ||
+                     task->expr.type == EXPR_CALL)) {
+        *find_built(&b, task->expr.value.op) =
+            (Built){.node = task->expr.value.op, .id = built};
+        b.builtCount++;
+      }
+    }
+  }
+}
+
+// Prints a node without children and returns true, or false for any other.
+static bool print_leaf(const Ast *ast, NodeId node) {
+  switch (ast->kinds[node]) {
+  case NODE_NULL:
+    printf("NULL");
+    return true;
+  case NODE_INT:
+    printf("%d", (int32_t)ast->lhs[node]);
+    return true;
+  case NODE_FLOAT: {
+    float value;
+    memcpy(&value, &ast->lhs[node], sizeof(value));
+    printf("%ff", value);
+    return true;
+  }
+  case NODE_LONG:
+    printf("%lldi64", (long long)ast->literals[ast->lhs[node]]);
+    return true;
+  case NODE_DOUBLE: {
+    double value;
+    memcpy(&value, &ast->literals[ast->lhs[node]], sizeof(value));
+    printf("%ff64", value);
+    return true;
+  }
+  case NODE_NAME:
+    printf("%s", atom_name(ast->lhs[node]));
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Children of an operation, call, block or function in print order: the
+// operands, the callee then the arguments, the statements, or the body.
+static uint32_t print_child_count(const Ast *ast, NodeId node) {
+  switch (ast->kinds[node]) {
+  case NODE_OP:
+    return 2;
+  case NODE_CALL:
+    return 1 + ast_list(ast, node)[0];
+  case NODE_BLOCK:
+    return ast_list(ast, node)[0];
+  default:
+    return 1;
+  }
+}
+
+static NodeId print_child(const Ast *ast, NodeId node, uint32_t i) {
+  switch (ast->kinds[node]) {
+  case NODE_OP:
+    return i ? ast->rhs[node] : ast->lhs[node];
+  case NODE_CALL:
+    return i ? ast_list(ast, node)[i] : ast->lhs[node];
+  case NODE_BLOCK:
+    return ast_list(ast, node)[1 + i];
+  default:
+    return ast->lhs[node];
+  }
+}
+
+// Prints what comes before child i of node, or after the last child when i
+// is the child count.
+static void print_between(const Ast *ast, NodeId node, uint32_t i) {
+  uint32_t count = print_child_count(ast, node);
+  switch (ast->kinds[node]) {
+  case NODE_OP:
+    if (i == 1) {
+      printf(" %c ", ast->ops[node]);
+    } else {
+      printf(i == 0 ? "(" : ")");
+    }
+    break;
+  case NODE_CALL:
+    if (i == count) {
+      printf(count == 1 ? "()" : ")");
+    } else if (i > 0) {
+      printf(i == 1 ? "(" : ", ");
+    }
+    break;
+  case NODE_BLOCK:
+    if (i == 0) {
+      printf("{\n");
+    } else {
+      printf(";\n");
+    }
+    if (i == count) {
+      printf("}");
+    }
+    break;
+  default:
+    if (i == 0) {
+      const uint32_t *args = ast_list(ast, node);
+      printf("(");
+      for (uint32_t j = 0; j < args[0]; j++) {
+        printf("%s", atom_name(args[1 + 2 * j]));
+        printf(":");
+        printf("%s", atom_name(args[2 + 2 * j]));
+        if (j < args[0] - 1) {
+          printf(", ");
+        }
+      }
+      printf(") => ");
+    }
+    break;
+  }
+}
+
+// A node whose children are being printed.
+typedef struct {
+  NodeId node;
+  uint32_t next; // index of the next child to print
+} Printing;
+
+void ast_print(const Ast *ast, NodeId node) {
+  // an explicit stack rather than recursion, so deep trees can't overflow
+  // the C stack
+  Printing *stack = NULL;
+  size_t count = 0, capacity = 0;
+  for (;;) {
+    if (!print_leaf(ast, node)) {
+      if (count == capacity) {
+        capacity = capacity ? capacity * 2 : 64;
+        stack = realloc(stack, capacity * sizeof(Printing));
+      }
+      stack[count++] = (Printing){.node = node};
+    }
+    // close finished nodes, then go on with the next child of the innermost
+    // open one
+    while (count > 0) {
+      Printing *top = &stack[count - 1];
+      print_between(ast, top->node, top->next);
+      if (top->next < print_child_count(ast, top->node)) {
+        node = print_child(ast, top->node, top->next++);
+        break;
+      }
+      count--;
+    }
+    if (count == 0) {
+      break;
+    }
+  }
+  free(stack);
+}
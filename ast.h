@@ -0,0 +1,76 @@
+#ifndef AST_H
+#define AST_H
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "parser.h"
+
+// Index of a node in an Ast.
+typedef uint32_t NodeId;
+
+#define NODE_NONE UINT32_MAX
+
+typedef enum {
+  NODE_NULL,
+  NODE_INT,    // lhs: value
+  NODE_FLOAT,  // lhs: bits of the float
+  NODE_LONG,   // lhs: index into literals
+  NODE_DOUBLE, // lhs: index into literals, bits of the double
+  NODE_NAME,   // lhs: Atom, rhs: binding, op: declared type of the binding
+  NODE_OP,     // lhs, rhs: operands, op: Operator
+  NODE_CALL,   // lhs: callee, rhs: extra index of argc, then the arguments
+  NODE_BLOCK,  // lhs: extra index of stmtc, then the statements, op: returns
+  NODE_FUNC,   // lhs: body, rhs: extra index of argc, then name, type pairs
+} NodeKind;
+
+// A name is bound to argument `index` of the function `up` levels out from
+// the innermost one around it, or NODE_NONE when nothing binds it.
+#define BINDING(up, index) ((uint32_t)(up) << 16 | (uint32_t)(index))
+#define BINDING_UP(binding) ((binding) >> 16)
+#define BINDING_INDEX(binding) ((binding)&0xffff)
+
+// An expression stored as parallel arrays, one entry per node, with
+// children referenced by index. Nodes are in post order: children come
+// before their parents, so bottom-up passes are a single forward sweep and
+// the root is always the last node. Subtrees shared by parse_shared stay
+// shared.
+typedef struct {
+  uint8_t *kinds;
+  uint8_t *ops;
+  uint32_t *lhs;
+  uint32_t *rhs;
+  uint8_t *types; // set by annotate_ast_types
+  NodeId count;
+  NodeId capacity;
+  uint32_t *extra; // child and argument lists
+  uint32_t extraCount;
+  uint32_t extraCapacity;
+  uint64_t *literals; // 64 bit literal values
+  uint32_t literalCount;
+  uint32_t literalCapacity;
+  bool shared; // built from parse_shared, so a node may have several parents
+} Ast;
+
+// Flattens expr into a new ast with an explicit stack, so tree depth is
+// only bounded by memory. Names are resolved to their bindings here,
+// so later passes never look them up. shared says expr came from
+// parse_shared; only then are nodes looked up so a shared subtree is built
+// once.
+void ast_build(Ast *ast, Expr expr, bool shared, Arena *arena);
+
+// Stores a 64 bit literal and returns its index.
+uint32_t ast_add_literal(Ast *ast, uint64_t bits, Arena *arena);
+
+static inline NodeId ast_root(const Ast *ast) { return ast->count - 1; }
+
+// The list a call, block or function node points at: its length, then the
+// entries.
+static inline const uint32_t *ast_list(const Ast *ast, NodeId node) {
+  return &ast->extra[ast->kinds[node] == NODE_BLOCK ? ast->lhs[node]
+                                                    : ast->rhs[node]];
+}
+
+void ast_print(const Ast *ast, NodeId node);
+
+#endif
@@ -0,0 +1,312 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena.h"
+#include "ast.h"
+#include "compiler.h"
+#include "intern.h"
+#include "memtracker.h"
+#include "parser.h"
+#include "sb.h"
+#include "tokeniser.h"
+#include "type.h"
+#include "workload.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Times tokenize, parse, ast_build, annotate_ast_types and compile_function
+// separately over generated workloads.
+// usage: frontend-bench [-w workload] [-n size] [-i iterations]
+//                       [-o file.pv]
+// -o writes the generated program out instead of benchmarking it.
+
+typedef enum { PHASE_TOKENIZE, PHASE_PARSE, PHASE_FLATTEN, PHASE_TYPE,
+               PHASE_CODEGEN, PHASE_COUNT } Phase;
+
+static const char *phaseNames[PHASE_COUNT] = {"tokenize", "parse", "flatten",
+                                              "type", "codegen"};
+
+// Default sizes keep the recursive passes well within the stack.
+static const int defaultSizes[WORKLOAD_COUNT] = {20000, 2000, 20000, 2000,
+                                                 20000};
+
+enum { COUNTER_CYCLES, COUNTER_INSTRUCTIONS, COUNTER_CACHE_MISSES,
+       COUNTER_COUNT };
+
+// Hardware counters for the calling thread, or fds of -1 when
+// perf_event_open is unavailable.
+typedef struct {
+  int fds[COUNTER_COUNT];
+  uint64_t totals[PHASE_COUNT][COUNTER_COUNT];
+} Counters;
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void counters_open(Counters *counters) {
+  memset(counters, 0, sizeof(*counters));
+  for (int i = 0; i < COUNTER_COUNT; i++) {
+    counters->fds[i] = -1;
+  }
+#ifdef __linux__
+  static const uint64_t configs[COUNTER_COUNT] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_MISSES};
+  for (int i = 0; i < COUNTER_COUNT; i++) {
+    struct perf_event_attr attr = {.type = PERF_TYPE_HARDWARE,
+                                   .size = sizeof(attr),
+                                   .config = configs[i],
+                                   .disabled = 1,
+                                   .exclude_kernel = 1,
+                                   .exclude_hv = 1};
+    counters->fds[i] =
+        (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+#endif
+}
+
+static bool counters_available(Counters *counters) {
+  return counters->fds[COUNTER_CYCLES] >= 0;
+}
+
+static void counters_start(Counters *counters) {
+#ifdef __linux__
+  for (int i = 0; i < COUNTER_COUNT; i++) {
+    if (counters->fds[i] >= 0) {
+      ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+#endif
+  (void)counters;
+}
+
+static void counters_stop(Counters *counters, Phase phase) {
+#ifdef __linux__
+  for (int i = 0; i < COUNTER_COUNT; i++) {
+    uint64_t value;
+    if (counters->fds[i] >= 0) {
+      ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+      if (read(counters->fds[i], &value, sizeof(value)) == sizeof(value)) {
+        counters->totals[phase][i] += value;
+      }
+    }
+  }
+#endif
+  (void)counters, (void)phase;
+}
+
+static void counters_close(Counters *counters) {
+#ifdef __linux__
+  for (int i = 0; i < COUNTER_COUNT; i++) {
+    if (counters->fds[i] >= 0) {
+      close(counters->fds[i]);
+    }
+  }
+#endif
+  (void)counters;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Nearest rank percentile of a sorted sample.
+static double percentile(double *sorted, int count, double fraction) {
+  int rank = (int)(fraction * count + 0.999999);
+  rank = rank < 1 ? 1 : rank > count ? count : rank;
+  return sorted[rank - 1];
+}
+
+static char *run_workload(Workload workload, int size, int iterations,
+                          Counters *counters) {
+  StringBuilder program = {0};
+  generate_workload(&program, workload, size);
+
+  double *times = malloc(sizeof(double) * PHASE_COUNT * iterations);
+  memset(counters->totals, 0, sizeof(counters->totals));
+  int tokenCount = 0;
+  long nodeCount = 0;
+  char *error = NULL;
+
+  for (int i = 0; i < iterations && !error; i++) {
+    Arena arena = {0};
+    TokenStream tokens = {0};
+    Expr expr = {.type = EXPR_NULL};
+    Ast ast = {0};
+    StringBuilder impl = {0};
+    double phaseStart[PHASE_COUNT + 1];
+
+    phaseStart[PHASE_TOKENIZE] = now_ns();
+    counters_start(counters);
+    error = tokenize(&tokens, program.data, program.length, &arena);
+    counters_stop(counters, PHASE_TOKENIZE);
+
+    phaseStart[PHASE_PARSE] = now_ns();
+    if (!error) {
+      counters_start(counters);
+      error = parse(&expr, &tokens, (TokenSlice){0, tokens.length}, &arena);
+      counters_stop(counters, PHASE_PARSE);
+    }
+
+    phaseStart[PHASE_FLATTEN] = now_ns();
+    if (!error) {
+      counters_start(counters);
+      ast_build(&ast, expr, false, &arena);
+      counters_stop(counters, PHASE_FLATTEN);
+    }
+
+    phaseStart[PHASE_TYPE] = now_ns();
+    if (!error) {
+      counters_start(counters);
+      error = annotate_ast_types(&ast);
+      counters_stop(counters, PHASE_TYPE);
+      if (!error && ast.types[ast.lhs[ast_root(&ast)]] == TYPE_NULL) {
+        error = "Can't infer the return type";
+      }
+    }
+
+    phaseStart[PHASE_CODEGEN] = now_ns();
+    if (!error) {
+      counters_start(counters);
+      error = compile_function(&impl, &ast, ast_root(&ast), "main", &arena);
+      counters_stop(counters, PHASE_CODEGEN);
+    }
+    phaseStart[PHASE_COUNT] = now_ns();
+
+    for (int p = 0; p < PHASE_COUNT; p++) {
+      times[p * iterations + i] = phaseStart[p + 1] - phaseStart[p];
+    }
+    if (i == 0 && !error) {
+      tokenCount = tokens.length;
+      nodeCount = ast.count;
+    }
+    free(impl.data);
+    arena_free(&arena);
+  }
+  if (error) {
+    free(times);
+    free(program.data);
+    return error;
+  }
+
+  printf("%s: %zu bytes, %d tokens, %ld nodes, %d iterations\n",
+         workload_name(workload), program.length, tokenCount, nodeCount,
+         iterations);
+  printf("  %-9s %9s %9s %9s %9s %10s", "phase", "p50 ms", "p90 ms",
+         "p99 ms", "MB/s", "Mnodes/s");
+  if (counters_available(counters)) {
+    printf(" %12s %12s %6s %10s", "cycles", "instrs", "IPC", "misses");
+  }
+  printf("\n");
+  for (int p = 0; p < PHASE_COUNT; p++) {
+    double *sample = times + p * iterations;
+    qsort(sample, iterations, sizeof(double), compare_doubles);
+    double median = percentile(sample, iterations, 0.5);
+    printf("  %-9s %9.3f %9.3f %9.3f %9.1f %10.2f", phaseNames[p],
+           median / 1e6, percentile(sample, iterations, 0.9) / 1e6,
+           percentile(sample, iterations, 0.99) / 1e6,
+           program.length / median * 1e3, nodeCount / median * 1e3);
+    if (counters_available(counters)) {
+      uint64_t *totals = counters->totals[p];
+      printf(" %12llu %12llu %6.2f %10llu",
+             (unsigned long long)(totals[COUNTER_CYCLES] / iterations),
+             (unsigned long long)(totals[COUNTER_INSTRUCTIONS] / iterations),
+             totals[COUNTER_CYCLES]
+                 ? (double)totals[COUNTER_INSTRUCTIONS] /
+                       totals[COUNTER_CYCLES]
+                 : 0.0,
+             (unsigned long long)(totals[COUNTER_CACHE_MISSES] / iterations));
+    }
+    printf("\n");
+  }
+
+  free(times);
+  free(program.data);
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  int only = -1;
+  int size = 0;
+  int iterations = 20;
+  const char *outPath = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+      i++;
+      for (int w = 0; w < WORKLOAD_COUNT; w++) {
+        if (strcmp(argv[i], workload_name(w)) == 0) {
+          only = w;
+        }
+      }
+      if (only < 0) {
+        fprintf(stderr, "Unknown workload %s\n", argv[i]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      size = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+      iterations = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      outPath = argv[++i];
+    } else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (iterations < 1) {
+    iterations = 1;
+  }
+
+  if (outPath) {
+    Workload workload = only < 0 ? WORKLOAD_CHAIN : (Workload)only;
+    StringBuilder program = {0};
+    generate_workload(&program, workload,
+                      size > 0 ? size : defaultSizes[workload]);
+    FILE *file = fopen(outPath, "wb");
+    if (!file) {
+      fprintf(stderr, "Failed to open %s\n", outPath);
+      return 1;
+    }
+    fwrite(program.data, 1, program.length, file);
+    fclose(file);
+    free(program.data);
+    return 0;
+  }
+
+  Counters counters;
+  counters_open(&counters);
+  if (!counters_available(&counters)) {
+    printf("hardware counters unavailable\n");
+  }
+  int status = 0;
+  for (int w = 0; w < WORKLOAD_COUNT; w++) {
+    if (only >= 0 && w != only) {
+      continue;
+    }
+    char *error = run_workload(w, size > 0 ? size : defaultSizes[w],
+                               iterations, &counters);
+    if (error) {
+      fprintf(stderr, "%s: Error: %s\n", workload_name(w), error);
+      status = 1;
+    }
+  }
+  counters_close(&counters);
+  intern_free();
+  return status;
+}
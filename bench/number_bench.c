@@ -0,0 +1,276 @@
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "number.h"
+
+// Checks parse_number against strtod, strtof and strtoll on fuzzed
+// literals plus exact halfway, subnormal and overflow cases, then compares
+// their throughput.
+// usage: number-bench [fuzz cases]
+
+#define LITERAL_MAX 1024
+#define TIMING_LITERALS 200000
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t rng = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t next_random(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return rng;
+}
+
+static size_t append_digits(char *buf, size_t len, int count) {
+  for (int i = 0; i < count; i++) {
+    buf[len++] = (char)('0' + next_random() % 10);
+  }
+  return len;
+}
+
+// A float literal without its suffix: integer digits, an optional fraction
+// and an optional exponent, with enough digits to pass 19 sometimes.
+static size_t fuzz_float(char *buf) {
+  size_t len = append_digits(buf, 0, 1 + (int)(next_random() % 24));
+  bool decimal = false;
+  if (next_random() % 4) {
+    buf[len++] = '.';
+    len = append_digits(buf, len, (int)(next_random() % 30));
+    decimal = true;
+  }
+  if (!decimal || next_random() % 2) {
+    buf[len++] = next_random() % 2 ? 'e' : 'E';
+    int sign = (int)(next_random() % 3);
+    if (sign) {
+      buf[len++] = sign == 1 ? '-' : '+';
+    }
+    len += (size_t)sprintf(buf + len, "%d", (int)(next_random() % 360));
+  }
+  return len;
+}
+
+static uint64_t random_bits(bool single) {
+  uint64_t bits = next_random();
+  return single ? bits & 0x7fffffff : bits & 0x7fffffffffffffffULL;
+}
+
+// The exact decimal expansion of the value halfway between a random finite
+// float and the next one up, which only ties-to-even rounds correctly.
+static size_t halfway(char *buf, bool single) {
+  for (;;) {
+    uint64_t bits = random_bits(single);
+    long double mid;
+    if (single) {
+      float low, high;
+      uint32_t raw = (uint32_t)bits, next = raw + 1;
+      memcpy(&low, &raw, sizeof(low));
+      memcpy(&high, &next, sizeof(high));
+      if (!isfinite(high)) {
+        continue;
+      }
+      mid = ((long double)low + high) / 2;
+    } else {
+      double low, high;
+      uint64_t next = bits + 1;
+      memcpy(&low, &bits, sizeof(low));
+      memcpy(&high, &next, sizeof(high));
+      if (!isfinite(high)) {
+        continue;
+      }
+      mid = ((long double)low + high) / 2;
+    }
+    // enough digits for any binary64 midpoint to print exactly
+    return (size_t)snprintf(buf, LITERAL_MAX, "%.*Le", single ? 160 : 800,
+                            mid);
+  }
+}
+
+// Literals near the smallest subnormal and the largest finite value.
+static size_t edge(char *buf, bool single) {
+  static const char *doubleEdges[] = {"4.9406564584124654e-324",
+                                      "2.4703282292062327e-324",
+                                      "2.2250738585072011e-308",
+                                      "1.7976931348623157e308",
+                                      "1.7976931348623158e308",
+                                      "1.797693134862315807e308"};
+  static const char *floatEdges[] = {"1.40129846e-45", "7.00649232e-46",
+                                     "1.17549435e-38", "3.40282346e38",
+                                     "3.40282357e38", "3.4028236e38"};
+  const char *base = single ? floatEdges[next_random() % 6]
+                            : doubleEdges[next_random() % 6];
+  // perturb the last few digits before the exponent
+  const char *e = strchr(base, 'e');
+  size_t mantissa = (size_t)(e - base);
+  memcpy(buf, base, mantissa);
+  size_t keep = mantissa - next_random() % 4;
+  size_t len = append_digits(buf, keep, (int)(mantissa - keep));
+  strcpy(buf + len, e);
+  return len + strlen(e);
+}
+
+// Parses buf with the given suffix and compares with the C library.
+static bool check_float(const char *text, size_t textLen, bool single) {
+  char buf[LITERAL_MAX + 4];
+  memcpy(buf, text, textLen);
+  memcpy(buf + textLen, single ? "f32" : "f64", 3);
+  Number number;
+  size_t end;
+  char *error = parse_number(buf, 0, textLen + 3, &number, &end);
+
+  char copy[LITERAL_MAX + 1];
+  memcpy(copy, text, textLen);
+  copy[textLen] = '\0';
+  uint64_t expected;
+  bool overflow;
+  if (single) {
+    float value = strtof(copy, NULL);
+    uint32_t raw;
+    memcpy(&raw, &value, sizeof(raw));
+    expected = raw;
+    overflow = isinf(value);
+  } else {
+    double value = strtod(copy, NULL);
+    memcpy(&expected, &value, sizeof(expected));
+    overflow = isinf(value);
+  }
+
+  bool ok;
+  uint64_t got = 0;
+  if (overflow) {
+    ok = error != NULL;
+  } else if (error || end != textLen + 3 ||
+             number.type != (single ? NUMBER_F32 : NUMBER_F64)) {
+    ok = false;
+  } else {
+    if (single) {
+      uint32_t raw;
+      memcpy(&raw, &number.value.f32, sizeof(raw));
+      got = raw;
+    } else {
+      memcpy(&got, &number.value.f64, sizeof(got));
+    }
+    ok = got == expected;
+  }
+  if (!ok) {
+    fprintf(stderr, "%s: %.*s%s\n  got %016llx (%s), expected %016llx\n",
+            single ? "f32" : "f64", (int)textLen, text,
+            single ? "f32" : "f64", (unsigned long long)got,
+            error ? error : "ok", (unsigned long long)expected);
+  }
+  return ok;
+}
+
+static bool check_integer(void) {
+  char buf[64];
+  size_t len = append_digits(buf, 0, 1 + (int)(next_random() % 20));
+  bool wide = next_random() % 2;
+  memcpy(buf + len, wide ? "i64" : "i32", 3);
+  Number number;
+  size_t end;
+  char *error = parse_number(buf, 0, len + 3, &number, &end);
+
+  buf[len] = '\0';
+  errno = 0;
+  unsigned long long value = strtoull(buf, NULL, 10);
+  bool fits = errno == 0 && value <= (wide ? INT64_MAX : INT32_MAX);
+  bool ok = fits ? !error && end == len + 3 &&
+                       (wide ? number.type == NUMBER_I64 &&
+                                   (unsigned long long)number.value.i64 ==
+                                       value
+                             : number.type == NUMBER_I32 &&
+                                   (unsigned long long)number.value.i32 ==
+                                       value)
+                 : error != NULL;
+  if (!ok) {
+    fprintf(stderr, "%s%s: %s\n", buf, wide ? "i64" : "i32",
+            error ? error : "accepted");
+  }
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  long cases = argc > 1 ? atol(argv[1]) : 1000000;
+
+  char *text = malloc(LITERAL_MAX + 1);
+  long failures = 0;
+  for (long i = 0; i < cases && failures < 10; i++) {
+    bool single = next_random() % 2;
+    size_t len;
+    switch (next_random() % 8) {
+    case 0:
+      len = halfway(text, single);
+      break;
+    case 1:
+      len = edge(text, single);
+      break;
+    default:
+      len = fuzz_float(text);
+      break;
+    }
+    failures += !check_float(text, len, single);
+    failures += !check_integer();
+  }
+  printf("fuzz: %ld cases, %ld mismatches\n", cases, failures);
+
+  // a mix of short and long literals, as they would appear in source
+  size_t capacity = (size_t)TIMING_LITERALS * 48;
+  char *source = malloc(capacity);
+  size_t *starts = malloc(sizeof(size_t) * (TIMING_LITERALS + 1));
+  size_t length = 0;
+  for (int i = 0; i < TIMING_LITERALS; i++) {
+    starts[i] = length;
+    length += (size_t)sprintf(source + length, "%d.%0*d",
+                              (int)(next_random() % 100000),
+                              1 + (int)(next_random() % 12),
+                              (int)(next_random() % 1000000));
+    source[length++] = ' ';
+  }
+  starts[TIMING_LITERALS] = length;
+
+  printf("%-13s %10s\n", "parser", "MB/s");
+  for (int parser = 0; parser < 2; parser++) {
+    double fastest = 0;
+    volatile double sink = 0;
+    for (int run = 0; run < 5; run++) {
+      double start = now_ns();
+      for (int i = 0; i < TIMING_LITERALS; i++) {
+        size_t at = starts[i];
+        size_t literalLen = starts[i + 1] - 1 - at;
+        if (parser == 0) {
+          Number number;
+          size_t end;
+          parse_number(source, at, at + literalLen, &number, &end);
+          sink += number.value.f32;
+        } else {
+          // strtof needs a terminated copy
+          char copy[64];
+          memcpy(copy, source + at, literalLen);
+          copy[literalLen] = '\0';
+          sink += strtof(copy, NULL);
+        }
+      }
+      double elapsed = now_ns() - start;
+      if (run == 0 || elapsed < fastest) {
+        fastest = elapsed;
+      }
+    }
+    printf("%-13s %10.1f\n", parser == 0 ? "parse_number" : "strtof",
+           length / fastest * 1e3);
+  }
+
+  free(source);
+  free(starts);
+  free(text);
+  return failures ? 1 : 0;
+}
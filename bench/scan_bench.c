@@ -0,0 +1,186 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena.h"
+#include "intern.h"
+#include "sb.h"
+#include "scan.h"
+#include "tokeniser.h"
+#include "workload.h"
+
+// Checks every vector level of the lexer against the scalar one on fuzzed
+// input, then compares their tokenize throughput on large sources.
+// usage: scan-bench [fuzz cases] [megabytes]
+
+#define FUZZ_MAX_LENGTH 512
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t rng = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t next_random(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return rng;
+}
+
+// Runs of one kind of byte, long enough to cross vector boundaries, with
+// brackets that mostly balance so the whole lexer gets exercised.
+static size_t fuzz(char *buf, size_t max) {
+  static const char *pools[] = {" \t\n\r\v\f", "0123456789",
+                                "abcXYZ_019", "+-*/=>:,;.", "(){}",
+                                "\x80\xff\x01@[`~"};
+  size_t len = 0;
+  int depth = 0;
+  while (len < max) {
+    const char *pool = pools[next_random() % 6];
+    size_t poolLen = strlen(pool);
+    size_t run = 1 + next_random() % 40;
+    for (size_t i = 0; i < run && len < max; i++) {
+      char c = pool[next_random() % poolLen];
+      if (c == '(' || c == '{') {
+        depth++;
+      } else if (c == ')' || c == '}') {
+        if (depth == 0) {
+          continue;
+        }
+        depth--;
+      }
+      buf[len++] = c;
+    }
+  }
+  return len;
+}
+
+static bool same_tokens(TokenStream *a, TokenStream *b) {
+  if (a->length != b->length) {
+    return false;
+  }
+  for (int i = 0; i < a->length; i++) {
+    if (a->kinds[i] != b->kinds[i] ||
+        a->spans[i].offset != b->spans[i].offset ||
+        a->spans[i].length != b->spans[i].length) {
+      return false;
+    }
+    TokenValue x = a->values[i];
+    TokenValue y = b->values[i];
+    switch ((TokenKind)a->kinds[i]) {
+    case TT_INT:
+      if (x._int != y._int) {
+        return false;
+      }
+      break;
+    case TT_FLOAT:
+      if (memcmp(&x._float, &y._float, sizeof(float)) != 0) {
+        return false;
+      }
+      break;
+    case TT_OP:
+      if (x.op != y.op) {
+        return false;
+      }
+      break;
+    case TT_NAME:
+      if (x.name != y.name) {
+        return false;
+      }
+      break;
+    default:
+      if (x.group.match != y.group.match || x.group.next != y.group.next) {
+        return false;
+      }
+      break;
+    }
+  }
+  return true;
+}
+
+// Tokenizes buf at every supported level and compares with scalar.
+static bool check(const char *buf, size_t len, ScanLevel best) {
+  Arena arena = {0};
+  scan_set_level(SCAN_SCALAR);
+  TokenStream expected = {0};
+  char *expectedError = tokenize(&expected, buf, len, &arena);
+  bool ok = true;
+  for (ScanLevel level = SCAN_SSE2; level <= best && ok; level++) {
+    scan_set_level(level);
+    TokenStream tokens = {0};
+    char *error = tokenize(&tokens, buf, len, &arena);
+    ok = error == expectedError && (error || same_tokens(&expected, &tokens));
+    if (!ok) {
+      fprintf(stderr, "%s differs from scalar on:\n%.*s\n",
+              scan_level_name(level), (int)len, buf);
+    }
+  }
+  arena_free(&arena);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  long cases = argc > 1 ? atol(argv[1]) : 100000;
+  long megabytes = argc > 2 ? atol(argv[2]) : 8;
+
+  ScanLevel best = scan_level();
+  printf("best level: %s\n", scan_level_name(best));
+
+  char buf[FUZZ_MAX_LENGTH];
+  long failures = 0;
+  for (long i = 0; i < cases && failures < 10; i++) {
+    size_t len = fuzz(buf, 1 + next_random() % FUZZ_MAX_LENGTH);
+    // every suffix start shifts the vector alignment
+    size_t offset = next_random() % 32;
+    if (!check(buf + (offset < len ? offset : 0),
+               len - (offset < len ? offset : 0), best)) {
+      failures++;
+    }
+  }
+  printf("fuzz: %ld cases, %ld mismatches\n", cases, failures);
+
+  // one big module of blocks, and a mostly whitespace one
+  StringBuilder sources[2] = {{0}, {0}};
+  const char *names[2] = {"module", "sparse"};
+  size_t target = (size_t)megabytes * 1024 * 1024;
+  for (int i = 0; sources[0].length < target; i++) {
+    sb_printf(&sources[0], "function_%d = ", i);
+    generate_workload(&sources[0], WORKLOAD_BLOCK, 64);
+    sb_write(&sources[0], ";\n");
+  }
+  for (int i = 0; sources[1].length < target; i++) {
+    sb_printf(&sources[1], "%*s(value_%d,\n%*s1.25)\n", 60, "", i, 40, "");
+  }
+
+  printf("%-8s %-8s %10s\n", "source", "level", "MB/s");
+  for (int s = 0; s < 2; s++) {
+    check(sources[s].data, sources[s].length, best);
+    for (ScanLevel level = SCAN_SCALAR; level <= best; level++) {
+      scan_set_level(level);
+      double fastest = 0;
+      for (int run = 0; run < 5; run++) {
+        Arena arena = {0};
+        TokenStream tokens = {0};
+        double start = now_ns();
+        tokenize(&tokens, sources[s].data, sources[s].length, &arena);
+        double elapsed = now_ns() - start;
+        if (run == 0 || elapsed < fastest) {
+          fastest = elapsed;
+        }
+        arena_free(&arena);
+      }
+      printf("%-8s %-8s %10.1f\n", names[s], scan_level_name(level),
+             sources[s].length / fastest * 1e3);
+    }
+    free(sources[s].data);
+  }
+
+  intern_free();
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,143 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena.h"
+#include "bytecode.h"
+#include "eval.h"
+#include "intern.h"
+#include "jit.h"
+#include "parser.h"
+#include "source.h"
+#include "tokeniser.h"
+#include "type.h"
+
+// Compares the bytecode VM and the JIT against direct evaluation of the
+// same Expr.
+// usage: vm-bench [file.pv] [iterations] [args...]
+
+#define ARENA_RESET_INTERVAL 4096
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+  const char *path = argc > 1 ? argv[1] : "main.pv";
+  long iterations = argc > 2 ? atol(argv[2]) : 1000000;
+  int callArgc = argc > 3 ? argc - 3 : 0;
+
+  Source source;
+  char *error = source_open(&source, path);
+  if (error) {
+    fprintf(stderr, "%s\n", error);
+    return 1;
+  }
+
+  Arena arena = {0};
+  TokenStream tokens = {0};
+  error = tokenize(&tokens, source.data, source.len, &arena);
+  Expr expr = {.type = EXPR_NULL};
+  if (!error) {
+    error = parse(&expr, &tokens, (TokenSlice){0, tokens.length}, &arena);
+  }
+  if (!error && expr.type != EXPR_FUNC) {
+    error = "The program must be a function";
+  }
+  const Type *type;
+  if (!error) {
+    error = annotate_types(&expr, NULL, &type, &arena);
+  }
+  if (error) {
+    fprintf(stderr, "Error: %s\n", error);
+    return 1;
+  }
+
+  Value *values = arena_alloc(&arena, sizeof(Value) * callArgc);
+  Reg *regs = arena_alloc(&arena, sizeof(Reg) * callArgc);
+  for (int i = 0; i < callArgc; i++) {
+    if (strchr(argv[3 + i], '.')) {
+      regs[i].f32 = strtof(argv[3 + i], NULL);
+      values[i] = (Value){.type = EVAL_F32, .value._float = regs[i].f32};
+    } else {
+      regs[i].i32 = (int)strtol(argv[3 + i], NULL, 10);
+      values[i] = (Value){.type = EVAL_I32, .value._int = regs[i].i32};
+    }
+  }
+
+  BytecodeModule module = {0};
+  int chunk;
+  error = lower_function(&module, expr.value.func, &chunk, &arena);
+  if (error) {
+    fprintf(stderr, "Error: %s\n", error);
+    return 1;
+  }
+
+  Value func = {.type = EVAL_FUNC, .value.closure = {.func = expr.value.func}};
+  Value evalResult = {0};
+  Arena scratch = {0};
+  double start = now_ns();
+  for (long i = 0; i < iterations; i++) {
+    if (i % ARENA_RESET_INTERVAL == 0) {
+      arena_free(&scratch);
+    }
+    error = eval_call(func, values, callArgc, &evalResult, &scratch);
+    if (error) {
+      fprintf(stderr, "Error: %s\n", error);
+      return 1;
+    }
+  }
+  double evalNs = (now_ns() - start) / iterations;
+  arena_free(&scratch);
+
+  Reg vmResult = {0};
+  start = now_ns();
+  for (long i = 0; i < iterations; i++) {
+    error = vm_call(&module, chunk, regs, &vmResult);
+    if (error) {
+      fprintf(stderr, "Error: %s\n", error);
+      return 1;
+    }
+  }
+  double vmNs = (now_ns() - start) / iterations;
+
+  JitCode jit;
+  error = jit_compile(&jit, expr.value.func, &arena);
+  Reg jitResult = vmResult;
+  double jitNs = 0;
+  if (error) {
+    fprintf(stderr, "JIT unavailable: %s\n", error);
+  } else {
+    start = now_ns();
+    for (long i = 0; i < iterations; i++) {
+      if (jit.entry(regs, &jitResult)) {
+        fprintf(stderr, "Error: Division by zero\n");
+        return 1;
+      }
+    }
+    jitNs = (now_ns() - start) / iterations;
+  }
+
+  bool same = evalResult.type == EVAL_F32
+                  ? evalResult.value._float == vmResult.f32 &&
+                        vmResult.f32 == jitResult.f32
+                  : evalResult.value._int == vmResult.i32 &&
+                        vmResult.i32 == jitResult.i32;
+  printf("%ld iterations over %s\n", iterations, path);
+  printf("tree walk: %10.1f ns/call\n", evalNs);
+  printf("bytecode:  %10.1f ns/call (%.1fx)\n", vmNs, evalNs / vmNs);
+  if (!error) {
+    printf("jit:       %10.1f ns/call (%.1fx)\n", jitNs, evalNs / jitNs);
+  }
+  printf("results %s\n", same ? "match" : "DIFFER");
+
+  jit_free(&jit);
+  arena_free(&arena);
+  source_close(&source);
+  intern_free();
+  return same ? 0 : 1;
+}
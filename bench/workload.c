@@ -0,0 +1,54 @@
+#include "workload.h"
+#include "sb.h"
+
+static const char *names[WORKLOAD_COUNT] = {"chain", "nested", "block",
+                                            "calls", "literals"};
+
+static const char ops[] = {'+', '*', '-', '/'};
+
+const char *workload_name(Workload workload) { return names[workload]; }
+
+void generate_workload(StringBuilder *out, Workload workload, int size) {
+  switch (workload) {
+  case WORKLOAD_CHAIN:
+    sb_write(out, "(a: i32, b: i32, c: i32) => a");
+    for (int i = 0; i < size; i++) {
+      sb_printf(out, " %c %c", ops[i % 4], "abc"[i % 3]);
+    }
+    break;
+  case WORKLOAD_NESTED:
+    sb_write(out, "(a: i32) => ");
+    for (int i = 0; i < size; i++) {
+      sb_write(out, "(");
+    }
+    sb_write(out, "a");
+    for (int i = 0; i < size; i++) {
+      sb_printf(out, " %c %d)", ops[i % 4], i % 9 + 1);
+    }
+    break;
+  case WORKLOAD_BLOCK:
+    sb_write(out, "(a: i32, b: i32) => {\n");
+    for (int i = 0; i < size; i++) {
+      sb_printf(out, "  a %c b %c %d;\n", ops[i % 4], ops[(i + 1) % 4], i);
+    }
+    sb_write(out, "  a + b\n}");
+    break;
+  case WORKLOAD_CALLS:
+    sb_write(out, "(a: f32) => 0.0");
+    for (int i = 0; i < size; i++) {
+      sb_printf(out, " +\n  ((x: f32, y: f32) => x * y %c x)(a, %d.5)",
+                ops[i % 3], i);
+    }
+    break;
+  case WORKLOAD_LITERALS:
+    sb_write(out, "() => 0.125");
+    for (int i = 0; i < size; i++) {
+      sb_printf(out, " %c %d.%03d", ops[i % 3], i * 7919 % 100000,
+                i * 31 % 1000);
+    }
+    break;
+  case WORKLOAD_COUNT:
+    break;
+  }
+  sb_write(out, "\n");
+}
@@ -0,0 +1,22 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include "sb.h"
+
+// Synthetic programs stressing one part of the front end each. Every
+// workload is a typed function, so all phases up to codegen run on it.
+typedef enum {
+  WORKLOAD_CHAIN,    // one long flat operator chain
+  WORKLOAD_NESTED,   // deeply nested parentheses
+  WORKLOAD_BLOCK,    // a wide {...; ...} block
+  WORKLOAD_CALLS,    // many call sites of function literals
+  WORKLOAD_LITERALS, // mostly numeric literals
+  WORKLOAD_COUNT
+} Workload;
+
+const char *workload_name(Workload workload);
+
+// Appends a program of roughly size terms, statements or calls.
+void generate_workload(StringBuilder *out, Workload workload, int size);
+
+#endif
@@ -0,0 +1,381 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arena.h"
+#include "bytecode.h"
+#include "parser.h"
+#include "type.h"
+
+#define CONST_BASE 0x8000 // marks constant operands until the chunk is done
+#define MAX_REGS 0x7fff
+
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO
+#endif
+
+typedef struct {
+  BytecodeModule *module;
+  int index; // chunks may move while nested functions are lowered
+  FuncExpr *func;
+  int nextTemp;
+  Arena *arena;
+} Lowering;
+
+static void emit(Lowering *l, Opcode op, int dst, int a, int b) {
+  Chunk *chunk = &l->module->chunks[l->index];
+  if (chunk->codeLength == chunk->codeCapacity) {
+    int oldCapacity = chunk->codeCapacity;
+    chunk->codeCapacity = (chunk->codeCapacity + 1) * 2;
+    chunk->code = arena_realloc(l->arena, chunk->code,
+                                oldCapacity * sizeof(Instr),
+                                chunk->codeCapacity * sizeof(Instr));
+  }
+  chunk->code[chunk->codeLength++] = (Instr){
+      .op = op, .dst = (uint16_t)dst, .a = (uint16_t)a, .b = (uint16_t)b};
+}
+
+static int add_constant(Lowering *l, Reg value) {
+  Chunk *chunk = &l->module->chunks[l->index];
+  for (int i = 0; i < chunk->constantCount; i++) {
+    if (memcmp(&chunk->constants[i], &value, sizeof(Reg)) == 0) {
+      return CONST_BASE + i;
+    }
+  }
+  if (chunk->constantCount == chunk->constantCapacity) {
+    int oldCapacity = chunk->constantCapacity;
+    chunk->constantCapacity = (chunk->constantCapacity + 1) * 2;
+    chunk->constants = arena_realloc(l->arena, chunk->constants,
+                                     oldCapacity * sizeof(Reg),
+                                     chunk->constantCapacity * sizeof(Reg));
+  }
+  chunk->constants[chunk->constantCount] = value;
+  return CONST_BASE + chunk->constantCount++;
+}
+
+static int alloc_temp(Lowering *l) {
+  Chunk *chunk = &l->module->chunks[l->index];
+  int reg = l->nextTemp++;
+  if (reg - chunk->argc >= chunk->tempCount) {
+    chunk->tempCount = reg - chunk->argc + 1;
+  }
+  return reg;
+}
+
+static char *lower_expr(Lowering *l, Expr expr, int *reg);
+
+static char *lower_operation(Lowering *l, Operation *op, int *reg) {
+  const Type *left = op->left.resolved;
+  const Type *right = op->right.resolved;
+  if (!left || !right || left->type != right->type ||
+      (left->type != TYPE_I32 && left->type != TYPE_F32)) {
+    return "Operands must both be i32 or both be f32";
+  }
+
+  Opcode code;
+  switch (op->op) {
+  case OP_ADD:
+    code = BC_ADD_I32;
+    break;
+  case OP_SUB:
+    code = BC_SUB_I32;
+    break;
+  case OP_MUL:
+    code = BC_MUL_I32;
+    break;
+  case OP_DIV:
+    code = BC_DIV_I32;
+    break;
+  default:
+    return "Can't lower operator";
+  }
+  if (left->type == TYPE_F32) {
+    code += BC_ADD_F32 - BC_ADD_I32;
+  }
+
+  int mark = l->nextTemp;
+  int a, b;
+  char *error = lower_expr(l, op->left, &a);
+  if (error) {
+    return error;
+  }
+  error = lower_expr(l, op->right, &b);
+  if (error) {
+    return error;
+  }
+  // operands are read before the result is written, so it can reuse them
+  l->nextTemp = mark;
+  *reg = alloc_temp(l);
+  emit(l, code, *reg, a, b);
+  return NULL;
+}
+
+static char *lower_call(Lowering *l, CallExpr *call, int *reg) {
+  if (call->func.type != EXPR_FUNC) {
+    return "Can only call function literals";
+  }
+  FuncExpr *callee = call->func.value.func;
+  if (callee->argc != call->argc) {
+    return "Wrong number of arguments";
+  }
+
+  int chunk;
+  char *error = lower_function(l->module, callee, &chunk, l->arena);
+  if (error) {
+    return error;
+  }
+
+  // arguments are evaluated first, then moved into a contiguous window
+  int mark = l->nextTemp;
+  int *values = arena_alloc(l->arena, sizeof(int) * call->argc);
+  for (int i = 0; i < call->argc; i++) {
+    error = lower_expr(l, call->args[i], &values[i]);
+    if (error) {
+      return error;
+    }
+  }
+  int base = l->nextTemp;
+  for (int i = 0; i < call->argc; i++) {
+    int slot = alloc_temp(l);
+    emit(l, BC_MOV, slot, values[i], 0);
+  }
+  l->nextTemp = mark;
+  *reg = alloc_temp(l);
+  emit(l, BC_CALL, *reg, chunk, base);
+  return NULL;
+}
+
+static char *lower_expr(Lowering *l, Expr expr, int *reg) {
+  switch (expr.type) {
+  case EXPR_INT:
+    *reg = add_constant(l, (Reg){.i32 = expr.value._int});
+    return NULL;
+  case EXPR_FLOAT:
+    *reg = add_constant(l, (Reg){.f32 = expr.value._float});
+    return NULL;
+  case EXPR_NAME:
+    for (int i = 0; i < l->func->argc; i++) {
+      if (l->func->args[i].name == expr.value.name) {
+        *reg = i;
+        return NULL;
+      }
+    }
+    return "Can't lower a name that isn't an argument of its function";
+  case EXPR_OP:
+    return lower_operation(l, expr.value.op, reg);
+  case EXPR_CALL:
+    return lower_call(l, expr.value.call, reg);
+  case EXPR_BLOCK: {
+    BlockExpr *block = expr.value.block;
+    if (!block->returns || block->stmtc == 0) {
+      return "Can't lower a block without a value";
+    }
+    int mark = l->nextTemp;
+    for (int i = 0; i < block->stmtc; i++) {
+      l->nextTemp = mark;
+      char *error = lower_expr(l, block->stmts[i], reg);
+      if (error) {
+        return error;
+      }
+    }
+    return NULL;
+  }
+  case EXPR_LONG:
+  case EXPR_DOUBLE:
+    return "The VM only supports i32 and f32";
+  case EXPR_FUNC:
+    return "Can't lower a function value";
+  case EXPR_NULL:
+    break;
+  }
+  return "Can't lower expression";
+}
+
+static void resolve_operand(Chunk *chunk, uint16_t *operand) {
+  if (*operand >= CONST_BASE) {
+    *operand = (uint16_t)(chunk->argc + chunk->tempCount +
+                          (*operand - CONST_BASE));
+  }
+}
+
+char *lower_function(BytecodeModule *module, FuncExpr *func, int *chunk,
+                     Arena *arena) {
+  // registers are 32 bits wide
+  for (int i = 0; i < func->argc; i++) {
+    int type = parse_type(func->args[i].type).type;
+    if (type == TYPE_I64 || type == TYPE_F64) {
+      return "The VM only supports i32 and f32";
+    }
+  }
+  if (module->chunkCount == module->chunkCapacity) {
+    int oldCapacity = module->chunkCapacity;
+    module->chunkCapacity = (module->chunkCapacity + 1) * 2;
+    module->chunks = arena_realloc(arena, module->chunks,
+                                   oldCapacity * sizeof(Chunk),
+                                   module->chunkCapacity * sizeof(Chunk));
+  }
+  *chunk = module->chunkCount++;
+  module->chunks[*chunk] = (Chunk){.argc = func->argc};
+
+  Lowering l = {.module = module,
+                .index = *chunk,
+                .func = func,
+                .nextTemp = func->argc,
+                .arena = arena};
+  int result;
+  char *error = lower_expr(&l, func->body, &result);
+  if (error) {
+    return error;
+  }
+  emit(&l, BC_RET, 0, result, 0);
+
+  Chunk *c = &module->chunks[*chunk];
+  c->regCount = c->argc + c->tempCount + c->constantCount;
+  if (c->regCount > MAX_REGS) {
+    return "Function needs too many registers";
+  }
+  for (int i = 0; i < c->codeLength; i++) {
+    Instr *in = &c->code[i];
+    switch ((Opcode)in->op) {
+    case BC_CALL:
+      break;
+    case BC_RET:
+      resolve_operand(c, &in->a);
+      break;
+    case BC_MOV:
+      resolve_operand(c, &in->a);
+      break;
+    default:
+      resolve_operand(c, &in->a);
+      resolve_operand(c, &in->b);
+      break;
+    }
+  }
+  return NULL;
+}
+
+static char *run(BytecodeModule *module, Chunk *chunk, const Reg *args,
+                 Reg *out) {
+  Reg regs[chunk->regCount];
+  memcpy(regs, args, sizeof(Reg) * chunk->argc);
+  memcpy(regs + chunk->argc + chunk->tempCount, chunk->constants,
+         sizeof(Reg) * chunk->constantCount);
+
+  const Instr *ip = chunk->code;
+  const Instr *in;
+
+#ifdef VM_COMPUTED_GOTO
+  static void *dispatch[] = {
+      [BC_MOV] = &&do_BC_MOV,         [BC_ADD_I32] = &&do_BC_ADD_I32,
+      [BC_SUB_I32] = &&do_BC_SUB_I32, [BC_MUL_I32] = &&do_BC_MUL_I32,
+      [BC_DIV_I32] = &&do_BC_DIV_I32, [BC_ADD_F32] = &&do_BC_ADD_F32,
+      [BC_SUB_F32] = &&do_BC_SUB_F32, [BC_MUL_F32] = &&do_BC_MUL_F32,
+      [BC_DIV_F32] = &&do_BC_DIV_F32, [BC_CALL] = &&do_BC_CALL,
+      [BC_RET] = &&do_BC_RET,
+  };
+#define VM_NEXT()                                                              \
+  do {                                                                         \
+    in = ip++;                                                                 \
+    goto *dispatch[in->op];                                                    \
+  } while (0)
+#define VM_CASE(op) do_##op:
+#define VM_LOOP VM_NEXT();
+#define VM_END
+#else
+#define VM_NEXT() break
+#define VM_CASE(op) case op:
+#define VM_LOOP                                                                \
+  for (;;) {                                                                   \
+    in = ip++;                                                                 \
+    switch ((Opcode)in->op) {
+#define VM_END                                                                 \
+  }                                                                            \
+  }
+#endif
+
+  VM_LOOP
+  VM_CASE(BC_MOV) {
+    regs[in->dst] = regs[in->a];
+    VM_NEXT();
+  }
+  VM_CASE(BC_ADD_I32) {
+    regs[in->dst].i32 =
+        (int32_t)((uint32_t)regs[in->a].i32 + (uint32_t)regs[in->b].i32);
+    VM_NEXT();
+  }
+  VM_CASE(BC_SUB_I32) {
+    regs[in->dst].i32 =
+        (int32_t)((uint32_t)regs[in->a].i32 - (uint32_t)regs[in->b].i32);
+    VM_NEXT();
+  }
+  VM_CASE(BC_MUL_I32) {
+    regs[in->dst].i32 =
+        (int32_t)((uint32_t)regs[in->a].i32 * (uint32_t)regs[in->b].i32);
+    VM_NEXT();
+  }
+  VM_CASE(BC_DIV_I32) {
+    if (regs[in->b].i32 == 0) {
+      return "Division by zero";
+    }
+    regs[in->dst].i32 =
+        (int32_t)((uint32_t)regs[in->a].i32 / (uint32_t)regs[in->b].i32);
+    VM_NEXT();
+  }
+  VM_CASE(BC_ADD_F32) {
+    regs[in->dst].f32 = regs[in->a].f32 + regs[in->b].f32;
+    VM_NEXT();
+  }
+  VM_CASE(BC_SUB_F32) {
+    regs[in->dst].f32 = regs[in->a].f32 - regs[in->b].f32;
+    VM_NEXT();
+  }
+  VM_CASE(BC_MUL_F32) {
+    regs[in->dst].f32 = regs[in->a].f32 * regs[in->b].f32;
+    VM_NEXT();
+  }
+  VM_CASE(BC_DIV_F32) {
+    regs[in->dst].f32 = regs[in->a].f32 / regs[in->b].f32;
+    VM_NEXT();
+  }
+  VM_CASE(BC_CALL) {
+    char *error =
+        run(module, &module->chunks[in->a], &regs[in->b], &regs[in->dst]);
+    if (error) {
+      return error;
+    }
+    VM_NEXT();
+  }
+  VM_CASE(BC_RET) {
+    *out = regs[in->a];
+    return NULL;
+  }
+  VM_END
+
+#undef VM_NEXT
+#undef VM_CASE
+#undef VM_LOOP
+#undef VM_END
+  return "Invalid opcode";
+}
+
+char *vm_call(BytecodeModule *module, int chunk, const Reg *args, Reg *out) {
+  return run(module, &module->chunks[chunk], args, out);
+}
+
+void print_chunk(BytecodeModule *module, int chunk) {
+  static const char *names[] = {
+      [BC_MOV] = "mov",         [BC_ADD_I32] = "add.i32",
+      [BC_SUB_I32] = "sub.i32", [BC_MUL_I32] = "mul.i32",
+      [BC_DIV_I32] = "div.i32", [BC_ADD_F32] = "add.f32",
+      [BC_SUB_F32] = "sub.f32", [BC_MUL_F32] = "mul.f32",
+      [BC_DIV_F32] = "div.f32", [BC_CALL] = "call",
+      [BC_RET] = "ret",
+  };
+  Chunk *c = &module->chunks[chunk];
+  printf("chunk %d: %d args, %d temps, %d constants\n", chunk, c->argc,
+         c->tempCount, c->constantCount);
+  for (int i = 0; i < c->codeLength; i++) {
+    Instr in = c->code[i];
+    printf("  %-8s r%d, r%d, r%d\n", names[in.op], in.dst, in.a, in.b);
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+#include <stdint.h>
+
+#include "arena.h"
+#include "parser.h"
+
+typedef enum {
+  BC_MOV,
+  BC_ADD_I32,
+  BC_SUB_I32,
+  BC_MUL_I32,
+  BC_DIV_I32,
+  BC_ADD_F32,
+  BC_SUB_F32,
+  BC_MUL_F32,
+  BC_DIV_F32,
+  BC_CALL, // dst = chunks[a](regs[b], regs[b + 1], ...)
+  BC_RET,  // return regs[a]
+} Opcode;
+
+// Operands are register numbers. A chunk's registers are laid out as its
+// arguments, then temporaries, then the constant pool, which is copied in
+// at the start of every call.
+typedef struct {
+  uint16_t op;
+  uint16_t dst;
+  uint16_t a;
+  uint16_t b;
+} Instr;
+
+typedef union {
+  int32_t i32;
+  float f32;
+} Reg;
+
+typedef struct {
+  Instr *code;
+  int codeLength;
+  int codeCapacity;
+  Reg *constants;
+  int constantCount;
+  int constantCapacity;
+  int argc;
+  int tempCount;
+  int regCount;
+} Chunk;
+
+typedef struct {
+  Chunk *chunks;
+  int chunkCount;
+  int chunkCapacity;
+} BytecodeModule;
+
+// Lowers a function that has been through annotate_types. Nested function
+// literals are lowered into their own chunks; they may only be called
+// directly and may only refer to their own arguments.
+char *lower_function(BytecodeModule *module, FuncExpr *func, int *chunk,
+                     Arena *arena);
+
+// Runs chunk with argc(chunk) arguments and stores its return value.
+char *vm_call(BytecodeModule *module, int chunk, const Reg *args, Reg *out);
+
+void print_chunk(BytecodeModule *module, int chunk);
+
+#endif
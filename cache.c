@@ -0,0 +1,189 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cache.h"
+#include "hash.h"
+#include "memtracker.h"
+#include "source.h"
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define KEY_NAME_SIZE (SHA256_SIZE * 2 + 1)
+
+typedef struct {
+  char name[KEY_NAME_SIZE];
+  size_t size;
+  struct timespec used;
+} Entry;
+
+static void key_name(CacheKey key, char name[KEY_NAME_SIZE]) {
+  static const char digits[] = "0123456789abcdef";
+  for (int i = 0; i < SHA256_SIZE; i++) {
+    name[i * 2] = digits[key.bytes[i] >> 4];
+    name[i * 2 + 1] = digits[key.bytes[i] & 15];
+  }
+  name[SHA256_SIZE * 2] = '\0';
+}
+
+// dir/name in a malloced buffer.
+static char *entry_path(Cache *cache, const char *name) {
+  size_t len = strlen(cache->dir) + strlen(name) + 2;
+  char *path = malloc(len);
+  snprintf(path, len, "%s/%s", cache->dir, name);
+  return path;
+}
+
+CacheKey cache_key(CacheKind kind, const char *options, const char *data,
+                   size_t len) {
+  Sha256 hash;
+  sha256_init(&hash);
+  // the NULs keep the fields from running into each other
+  sha256_update(&hash, CACHE_VERSION, sizeof(CACHE_VERSION));
+  unsigned char tag = (unsigned char)kind;
+  sha256_update(&hash, &tag, 1);
+  sha256_update(&hash, options, strlen(options) + 1);
+  sha256_update(&hash, data, len);
+  CacheKey key;
+  sha256_final(&hash, key.bytes);
+  return key;
+}
+
+#ifdef _WIN32
+
+char *cache_open(Cache *cache, const char *dir, size_t limit) {
+  (void)cache, (void)dir, (void)limit;
+  return "Caching is not supported on this platform";
+}
+
+void cache_close(Cache *cache) { (void)cache; }
+
+bool cache_get(Cache *cache, CacheKey key, Source *out) {
+  (void)cache, (void)key, (void)out;
+  return false;
+}
+
+void cache_put(Cache *cache, CacheKey key, const char *data, size_t len) {
+  (void)cache, (void)key, (void)data, (void)len;
+}
+
+void cache_evict(Cache *cache) { (void)cache; }
+
+#else
+
+char *cache_open(Cache *cache, const char *dir, size_t limit) {
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+    return "Failed to create the cache directory";
+  }
+  size_t len = strlen(dir) + 1;
+  *cache = (Cache){.dir = malloc(len), .limit = limit};
+  memcpy(cache->dir, dir, len);
+  return NULL;
+}
+
+void cache_close(Cache *cache) {
+  free(cache->dir);
+  cache->dir = NULL;
+}
+
+bool cache_get(Cache *cache, CacheKey key, Source *out) {
+  char name[KEY_NAME_SIZE];
+  key_name(key, name);
+  char *path = entry_path(cache, name);
+  bool hit = source_open(out, path) == NULL;
+  if (hit) {
+    // bump the modification time so eviction sees the entry as fresh
+    utimensat(AT_FDCWD, path, NULL, 0);
+    cache->hits++;
+  } else {
+    cache->misses++;
+  }
+  free(path);
+  return hit;
+}
+
+void cache_put(Cache *cache, CacheKey key, const char *data, size_t len) {
+  char name[KEY_NAME_SIZE];
+  key_name(key, name);
+  char *path = entry_path(cache, name);
+  // write a private temporary and rename it, so concurrent compiles never
+  // see a partial entry
+  size_t tempLen = strlen(path) + 32;
+  char *temp = malloc(tempLen);
+  snprintf(temp, tempLen, "%s.%ld.tmp", path, (long)getpid());
+
+  FILE *file = fopen(temp, "wb");
+  if (file) {
+    bool ok = fwrite(data, 1, len, file) == len;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(temp, path) != 0) {
+      unlink(temp);
+    }
+  }
+  free(temp);
+  free(path);
+}
+
+static int compare_entries(const void *a, const void *b) {
+  const Entry *left = a;
+  const Entry *right = b;
+  if (left->used.tv_sec != right->used.tv_sec) {
+    return left->used.tv_sec < right->used.tv_sec ? -1 : 1;
+  }
+  if (left->used.tv_nsec != right->used.tv_nsec) {
+    return left->used.tv_nsec < right->used.tv_nsec ? -1 : 1;
+  }
+  return 0;
+}
+
+void cache_evict(Cache *cache) {
+  DIR *dir = opendir(cache->dir);
+  if (!dir) {
+    return;
+  }
+  Entry *entries = NULL;
+  size_t count = 0;
+  size_t capacity = 0;
+  size_t total = 0;
+  struct dirent *ent;
+  while ((ent = readdir(dir))) {
+    if (strlen(ent->d_name) != SHA256_SIZE * 2) {
+      continue;
+    }
+    struct stat stats;
+    if (fstatat(dirfd(dir), ent->d_name, &stats, 0) != 0 ||
+        !S_ISREG(stats.st_mode)) {
+      continue;
+    }
+    if (count == capacity) {
+      capacity = (capacity + 1) * 2;
+      entries = realloc(entries, capacity * sizeof(Entry));
+    }
+    Entry *entry = &entries[count++];
+    memcpy(entry->name, ent->d_name, KEY_NAME_SIZE);
+    entry->size = (size_t)stats.st_size;
+    entry->used = stats.st_mtim;
+    total += entry->size;
+  }
+
+  if (total > cache->limit) {
+    qsort(entries, count, sizeof(Entry), compare_entries);
+    for (size_t i = 0; i < count && total > cache->limit; i++) {
+      if (unlinkat(dirfd(dir), entries[i].name, 0) == 0) {
+        total -= entries[i].size;
+      }
+    }
+  }
+  closedir(dir);
+  free(entries);
+}
+
+#endif
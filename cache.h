@@ -0,0 +1,53 @@
+#ifndef CACHE_H
+#define CACHE_H
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "hash.h"
+#include "source.h"
+
+// Bump whenever the generated code changes for the same input, so stale
+// entries stop matching.
+#define CACHE_VERSION "preval-c 0.2"
+
+#define CACHE_DEFAULT_LIMIT (64 * 1024 * 1024)
+
+typedef struct {
+  unsigned char bytes[SHA256_SIZE];
+} CacheKey;
+
+// Directory of entries named by the hex of their key. Least recently used
+// entries are evicted once the total size passes limit; an entry's
+// modification time records its last use.
+typedef struct {
+  char *dir;
+  size_t limit;
+  unsigned long hits;
+  unsigned long misses;
+} Cache;
+
+// Creates dir if needed.
+char *cache_open(Cache *cache, const char *dir, size_t limit);
+
+void cache_close(Cache *cache);
+
+// What an entry holds. It is part of the key, so a whole file and a
+// definition with the same text never share an entry.
+typedef enum {
+  CACHE_FILE,       // a whole out.ll
+  CACHE_DEFINITION, // "<decl length>\n<decl><impl>" of one definition
+} CacheKind;
+
+// Hashes the compiler version, the kind, options and the input text.
+CacheKey cache_key(CacheKind kind, const char *options, const char *data,
+                   size_t len);
+
+// On a hit maps the entry into out, which the caller closes.
+bool cache_get(Cache *cache, CacheKey key, Source *out);
+
+void cache_put(Cache *cache, CacheKey key, const char *data, size_t len);
+
+// Removes least recently used entries until the cache fits its limit.
+void cache_evict(Cache *cache);
+
+#endif
@@ -1,146 +1,402 @@
+#include "ast.h"
 #include "compiler.h"
+#include "ir.h"
 #include "operator.h"
 #include "parser.h"
 #include "sb.h"
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-#include "memtracker.h"
+#include "arena.h"
+#include "intern.h"
+#include "trace.h"
 #include "type.h"
 
-#ifndef _WIN32
-#define _scprintf(format, ...) snprintf(NULL, 0, format, __VA_ARGS__)
-#endif
-
-char *type_to_llvm(Type type) {
-  switch (type.type) {
-  case TYPE_I32: {
-    return "i32";
+static IrType ir_type(uint8_t type) {
+  switch (type) {
+  case TYPE_I32:
+    return IR_I32;
+  case TYPE_F32:
+    return IR_F32;
+  case TYPE_I64:
+    return IR_I64;
+  case TYPE_F64:
+    return IR_F64;
+  default:
+    return IR_VOID;
   }
-  case TYPE_F32: {
-    return "f32";
+}
+
+// Values bound to the arguments of the function being lowered. Calls of
+// function literals are inlined, each with its own binding on top.
+typedef struct Binding {
+  int *values;
+  struct Binding *parent;
+} Binding;
+
+static int lookup_binding(Binding *env, uint32_t binding) {
+  if (binding == NODE_NONE) {
+    return -1;
   }
+  for (uint32_t up = BINDING_UP(binding); env && up > 0; up--) {
+    env = env->parent;
   }
-  return NULL;
+  return env ? env->values[BINDING_INDEX(binding)] : -1;
 }
 
+// Value already lowered for an operation or call node under one binding, so
+// nodes shared by parse_shared are emitted once and their result reused.
+// Without sharing no node is reached twice, so the table isn't kept.
 typedef struct {
-  char *name;
-  const char *type;
-} CompiledExpr;
-
-CompiledExpr compile_expr(StringBuilder *decl, StringBuilder *impl, Expr expr,
-                          int *name);
-
-CompiledExpr compile_operation(StringBuilder *decl, StringBuilder *impl,
-                               Operation op, int *name) {
-  Type leftType = infer_type(op.left, NULL, 0);
-  Type rightType = infer_type(op.right, NULL, 0);
-  if ((leftType.type == TYPE_I32 && rightType.type == TYPE_I32) ||
-      (leftType.type == TYPE_F32 && leftType.type == TYPE_F32)) {
-    CompiledExpr left = compile_expr(decl, impl, op.left, name);
-    CompiledExpr right = compile_expr(decl, impl, op.right, name);
-    char *nameStr = malloc(12);
-    sprintf(nameStr, "%%%d", *name);
-    sb_write(impl, nameStr);
-    sb_write(impl, " = ");
-    switch (op.op) {
-    case OP_ADD: {
-      sb_write(impl, "add ");
-      break;
+  NodeId node; // NODE_NONE when empty
+  Binding *env;
+  int value;
+} Lowered;
+
+// An operation, call or block whose children are being lowered.
+typedef struct {
+  NodeId node;
+  Binding *env;
+  uint32_t next;    // index of the next child to lower
+  int left;         // operation: value of the left operand
+  int last;         // value of the child lowered last
+  Binding *binding; // call: filled with the arguments, then binds the body
+} Task;
+
+typedef struct {
+  const Ast *ast;
+  IrFunction *fn;
+  char *error; // the first error; lowering stops once it is set
+  Lowered *lowered;
+  size_t count;
+  size_t capacity; // always a power of two
+  Task *tasks;
+  int taskCount;
+  int taskCapacity;
+  Arena *arena;
+} Lowering;
+
+static size_t hash_lowered(NodeId node, Binding *env) {
+  uint64_t x = (uint64_t)node ^ (uint64_t)(uintptr_t)env * 31;
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  return (size_t)x;
+}
+
+static Lowered *find_lowered(Lowering *l, NodeId node, Binding *env) {
+  if ((l->count + 1) * 2 > l->capacity) {
+    size_t capacity = l->capacity ? l->capacity * 2 : 64;
+    Lowered *lowered = arena_alloc(l->arena, capacity * sizeof(Lowered));
+    for (size_t i = 0; i < capacity; i++) {
+      lowered[i].node = NODE_NONE;
     }
-    case OP_SUB: {
-      sb_write(impl, "sub ");
-      break;
+    for (size_t i = 0; i < l->capacity; i++) {
+      Lowered entry = l->lowered[i];
+      if (entry.node != NODE_NONE) {
+        size_t slot = hash_lowered(entry.node, entry.env) & (capacity - 1);
+        while (lowered[slot].node != NODE_NONE) {
+          slot = (slot + 1) & (capacity - 1);
+        }
+        lowered[slot] = entry;
+      }
     }
-    case OP_DIV: {
-      if (op.left.type == EXPR_INT) {
-        sb_write(impl, "udiv ");
-      } else {
-        sb_write(impl, "fdiv ");
+    l->lowered = lowered;
+    l->capacity = capacity;
+  }
+  size_t mask = l->capacity - 1;
+  size_t slot = hash_lowered(node, env) & mask;
+  while (l->lowered[slot].node != NODE_NONE &&
+         (l->lowered[slot].node != node || l->lowered[slot].env != env)) {
+    slot = (slot + 1) & mask;
+  }
+  return &l->lowered[slot];
+}
+
+static int fail(Lowering *l, char *error) {
+  if (!l->error) {
+    l->error = error;
+  }
+  return -1;
+}
+
+static bool ir_op(uint8_t op, IrOp *out) {
+  switch (op) {
+  case OP_ADD:
+    *out = IR_ADD;
+    return true;
+  case OP_SUB:
+    *out = IR_SUB;
+    return true;
+  case OP_MUL:
+    *out = IR_MUL;
+    return true;
+  case OP_DIV:
+    *out = IR_DIV;
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Returned by begin_node for a node whose children are still to be lowered.
+#define PENDING (-2)
+
+static void push_task(Lowering *l, Task task) {
+  if (l->taskCount == l->taskCapacity) {
+    int capacity = l->taskCapacity ? l->taskCapacity * 2 : 64;
+    l->tasks = arena_realloc(l->arena, l->tasks,
+                             l->taskCapacity * sizeof(Task),
+                             capacity * sizeof(Task));
+    l->taskCapacity = capacity;
+  }
+  l->tasks[l->taskCount++] = task;
+}
+
+// Lowers a node without children, or a node already lowered under env, and
+// returns its value. Any other node is pushed as a task and PENDING
+// returned.
+static int begin_node(Lowering *l, NodeId node, Binding *env) {
+  const Ast *ast = l->ast;
+  switch (ast->kinds[node]) {
+  case NODE_INT:
+    return ir_emit(l->fn,
+                   (IrInstr){.op = IR_CONST, .type = IR_I32,
+                             .imm.i32 = (int32_t)ast->lhs[node]},
+                   l->arena);
+  case NODE_FLOAT: {
+    IrInstr instr = {.op = IR_CONST, .type = IR_F32};
+    memcpy(&instr.imm.f32, &ast->lhs[node], sizeof(instr.imm.f32));
+    return ir_emit(l->fn, instr, l->arena);
+  }
+  case NODE_LONG:
+    return ir_emit(l->fn,
+                   (IrInstr){.op = IR_CONST, .type = IR_I64,
+                             .imm.i64 = (int64_t)ast->literals[ast->lhs[node]]},
+                   l->arena);
+  case NODE_DOUBLE: {
+    IrInstr instr = {.op = IR_CONST, .type = IR_F64};
+    memcpy(&instr.imm.f64, &ast->literals[ast->lhs[node]],
+           sizeof(instr.imm.f64));
+    return ir_emit(l->fn, instr, l->arena);
+  }
+  case NODE_NAME: {
+    int value = lookup_binding(env, ast->rhs[node]);
+    return value < 0 ? fail(l, "Unbound name") : value;
+  }
+  case NODE_OP: {
+    if (ast->shared) {
+      Lowered *lowered = find_lowered(l, node, env);
+      if (lowered->node != NODE_NONE) {
+        return lowered->value;
       }
-      break;
     }
-    case OP_MUL: {
-      sb_write(impl, "mul ");
-      break;
+    uint8_t type = ast->types[ast->lhs[node]];
+    IrOp irOp;
+    if (type != ast->types[ast->rhs[node]]) {
+      return fail(l, "Mismatched operand types");
+    }
+    if (ir_type(type) == IR_VOID) {
+      return fail(l, "Operands must be numbers");
     }
+    if (!ir_op(ast->ops[node], &irOp)) {
+      return fail(l, "Unsupported operator");
     }
-    (*name)++;
-    sb_write(impl, left.type);
-    sb_write(impl, " ");
-    sb_write(impl, left.name);
-    sb_write(impl, ", ");
-    sb_write(impl, right.name);
-    sb_write(impl, "\n");
-    free(left.name);
-    free(right.name);
-    return (CompiledExpr){.name = nameStr, .type = left.type};
+    push_task(l, (Task){.node = node, .env = env});
+    return PENDING;
+  }
+  case NODE_CALL: {
+    if (ast->shared) {
+      Lowered *lowered = find_lowered(l, node, env);
+      if (lowered->node != NODE_NONE) {
+        return lowered->value;
+      }
+    }
+    NodeId callee = ast->lhs[node];
+    const uint32_t *args = ast_list(ast, node);
+    if (ast->kinds[callee] != NODE_FUNC) {
+      return fail(l, "Only calls of function literals can be compiled");
+    }
+    if (ast_list(ast, callee)[0] != args[0]) {
+      return fail(l, "Wrong number of arguments");
+    }
+    // bindings key the lowered values, so each needs its own address
+    Binding *binding = arena_alloc(l->arena, sizeof(Binding));
+    *binding = (Binding){
+        .values = arena_alloc(l->arena, sizeof(int) * args[0]), .parent = env};
+    push_task(l, (Task){.node = node, .env = env, .binding = binding});
+    return PENDING;
+  }
+  case NODE_BLOCK:
+    push_task(l, (Task){.node = node, .env = env, .last = -1});
+    return PENDING;
+  default:
+    return -1;
   }
 }
 
-// this should return the way to get the value out of the expression
-CompiledExpr compile_expr(StringBuilder *decl, StringBuilder *impl, Expr expr,
-                          int *name) {
-  switch (expr.type) {
-  case EXPR_INT: {
-    char *str = malloc(_scprintf("%d", expr.value._int) + 1);
-    sprintf(str, "%d", expr.value._int);
-    return (CompiledExpr){.name = str, .type = "i32"};
-  }
-  case EXPR_FLOAT: {
-    char *str = malloc(_scprintf("%f", expr.value._float) + 1);
-    sprintf(str, "%f", expr.value._float);
-    return (CompiledExpr){.name = str, .type = "f32"};
-  }
-  case EXPR_OP: {
-    return compile_operation(decl, impl, *expr.value.op, name);
-  }
-  case EXPR_BLOCK: {
-    CompiledExpr last = {0};
-    for (size_t i = 0; i < expr.value.block->stmtc; i++) {
-      Expr stmt = expr.value.block->stmts[i];
-      CompiledExpr ref = compile_expr(decl, impl, stmt, name);
-      if (i >= expr.value.block->stmtc - 1) {
-        last = ref;
-      } else {
-        free(ref.name);
-      }
+// Takes the value of the child lowered last. Operands and arguments must
+// have one.
+static void take_value(Lowering *l, Task *task, int value) {
+  const Ast *ast = l->ast;
+  uint32_t i = task->next - 1;
+  NodeKind kind = ast->kinds[task->node];
+  bool used = kind == NODE_OP ||
+              (kind == NODE_CALL && i < ast_list(ast, task->node)[0]);
+  if (used && value < 0) {
+    fail(l, "Expression has no value");
+    return;
+  }
+  if (kind == NODE_OP && i == 0) {
+    task->left = value;
+  } else if (kind == NODE_CALL && i < ast_list(ast, task->node)[0]) {
+    task->binding->values[i] = ir_emit(
+        l->fn,
+        (IrInstr){.op = IR_COPY, .type = l->fn->instrs[value].type, .a = value},
+        l->arena);
+  } else {
+    task->last = value;
+  }
+}
+
+// The next child of task to lower and the binding to lower it under, or
+// false once all are lowered. A call lowers its arguments, then the body of
+// its callee under their binding.
+static bool next_child(Lowering *l, Task *task, NodeId *child, Binding **env) {
+  const Ast *ast = l->ast;
+  NodeId node = task->node;
+  *env = task->env;
+  switch (ast->kinds[node]) {
+  case NODE_OP:
+    if (task->next == 2) {
+      return false;
+    }
+    *child = task->next ? ast->rhs[node] : ast->lhs[node];
+    break;
+  case NODE_CALL: {
+    const uint32_t *args = ast_list(ast, node);
+    if (task->next > args[0]) {
+      return false;
     }
-    return last;
+    if (task->next == args[0]) {
+      *child = ast->lhs[ast->lhs[node]];
+      *env = task->binding;
+    } else {
+      *child = args[1 + task->next];
+    }
+    break;
   }
+  default: {
+    const uint32_t *stmts = ast_list(ast, node);
+    if (task->next == stmts[0]) {
+      return false;
+    }
+    *child = stmts[1 + task->next];
+    break;
   }
-  return (CompiledExpr){0};
+  }
+  task->next++;
+  return true;
 }
 
-void compile_function(StringBuilder *decl, StringBuilder *impl, FuncExpr func,
-                      char *name) {
-  sb_write(impl, "define ");
-  Type returnType = infer_type(func.body, NULL, 0);
-  sb_write(impl, type_to_llvm(returnType));
-  sb_write(impl, " @");
-  sb_write(impl, name);
-  sb_write(impl, "(");
-  for (size_t i = 0; i < func.argc; i++) {
-    Type type = parse_type(func.args[i].type);
-    sb_write(impl, type_to_llvm(type));
-    sb_write(impl, " %");
-    sb_write(impl, func.args[i].name);
-    sb_write(impl, ",");
-    free_type(type);
-  }
-
-  sb_write(impl, ")");
-  sb_write(impl, "{\n");
-
-  int varname = 1;
-  CompiledExpr var = compile_expr(decl, impl, func.body, &varname);
-  sb_write(impl, "ret ");
-  sb_write(impl, var.type);
-  sb_write(impl, var.name);
-  free(var.name);
-  sb_write(impl, "}\n");
-
-  free_type(returnType);
-}
\ No newline at end of file
+// The value of a task whose children are all lowered.
+static int finish_task(Lowering *l, Task *task) {
+  const Ast *ast = l->ast;
+  NodeId node = task->node;
+  int value;
+  switch (ast->kinds[node]) {
+  case NODE_OP: {
+    IrOp irOp;
+    ir_op(ast->ops[node], &irOp);
+    value = ir_emit(l->fn,
+                    (IrInstr){.op = irOp,
+                              .type = ir_type(ast->types[ast->lhs[node]]),
+                              .a = task->left,
+                              .b = task->last},
+                    l->arena);
+    break;
+  }
+  case NODE_CALL:
+    value = task->last;
+    break;
+  default:
+    return ast->ops[node] ? task->last : -1;
+  }
+  if (ast->shared) {
+    *find_lowered(l, node, task->env) =
+        (Lowered){.node = node, .env = task->env, .value = value};
+    l->count++;
+  }
+  return value;
+}
+
+// Lowers node into l->fn and returns the instruction holding its value, or
+// -1 when it has none or lowering failed. Children are lowered from an
+// explicit stack rather than by recursion, so deep trees can't overflow the
+// C stack.
+static int compile_expr(Lowering *l, NodeId node, Binding *env) {
+  int value = begin_node(l, node, env);
+  while (l->taskCount > 0 && !l->error) {
+    Task *task = &l->tasks[l->taskCount - 1];
+    if (value != PENDING) {
+      take_value(l, task, value);
+    }
+    NodeId child;
+    Binding *childEnv;
+    if (l->error) {
+      break;
+    } else if (next_child(l, task, &child, &childEnv)) {
+      value = begin_node(l, child, childEnv);
+    } else {
+      value = finish_task(l, task);
+      l->taskCount--;
+    }
+  }
+  l->taskCount = 0;
+  return l->error ? -1 : value;
+}
+
+char *compile_function(StringBuilder *impl, const Ast *ast, NodeId func,
+                       char *name, Arena *arena) {
+  const uint32_t *args = ast_list(ast, func);
+  int argc = (int)args[0];
+  NodeId body = ast->lhs[func];
+  if (ir_type(ast->types[body]) == IR_VOID) {
+    return "Can't infer the return type";
+  }
+  IrFunction fn = {.argc = argc,
+                   .argNames = arena_alloc(arena, sizeof(Atom) * argc),
+                   .argTypes = arena_alloc(arena, sizeof(IrType) * argc),
+                   .returnType = ir_type(ast->types[body])};
+  ir_begin_block(&fn, arena);
+
+  Binding binding = {.values = arena_alloc(arena, sizeof(int) * argc)};
+  for (int i = 0; i < argc; i++) {
+    fn.argNames[i] = args[1 + 2 * i];
+    fn.argTypes[i] = ir_type(parse_type(args[2 + 2 * i]).type);
+    binding.values[i] = ir_emit(
+        &fn, (IrInstr){.op = IR_ARG, .type = fn.argTypes[i], .imm.arg = i},
+        arena);
+  }
+
+  Lowering lowering = {.ast = ast, .fn = &fn, .arena = arena};
+  int result = compile_expr(&lowering, body, &binding);
+  if (result < 0) {
+    fail(&lowering, "Expression has no value");
+  }
+  if (lowering.error) {
+    return lowering.error;
+  }
+  ir_emit(&fn, (IrInstr){.op = IR_RET, .type = fn.returnType, .a = result},
+          arena);
+
+  // instructions as lowered, before the passes remove any
+  trace_count("ir instructions", fn.count);
+  ir_optimize(&fn, arena, false);
+  ir_print(impl, &fn, name, arena);
+  return NULL;
+}
@@ -1,8 +1,12 @@
 #ifndef COMPILER_H
 #define COMPILER_H
-#include "parser.h"
+#include "arena.h"
+#include "ast.h"
 #include "sb.h"
 
-void compile_function(StringBuilder *decl, StringBuilder *impl, FuncExpr func,
-                      char *name);
+// Lowers the function node func of ast, which must have been through
+// annotate_ast_types. Fails on the first node that can't be lowered, and
+// appends nothing to impl then.
+char *compile_function(StringBuilder *impl, const Ast *ast, NodeId func,
+                       char *name, Arena *arena);
 #endif
\ No newline at end of file
@@ -0,0 +1,367 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "eval.h"
+#include "memtracker.h"
+#include "intern.h"
+#include "number.h"
+#include "operator.h"
+#include "parser.h"
+#include "sb.h"
+#include "tokeniser.h"
+#include "type.h"
+
+struct EvalFrame {
+  FuncExpr *func;
+  Value *args;
+  EvalFrame *parent;
+};
+
+static char *apply_operation(Operator op, Value left, Value right,
+                             Value *out) {
+  if (left.type == EVAL_I32 && right.type == EVAL_I32) {
+    *out = (Value){.type = EVAL_I32};
+    if (!apply_int_op(op, left.value._int, right.value._int,
+                      &out->value._int)) {
+      return "Division by zero";
+    }
+  } else if (left.type == EVAL_F32 && right.type == EVAL_F32) {
+    *out = (Value){.type = EVAL_F32};
+    apply_float_op(op, left.value._float, right.value._float,
+                   &out->value._float);
+  } else if (left.type == EVAL_I64 && right.type == EVAL_I64) {
+    *out = (Value){.type = EVAL_I64};
+    if (!apply_long_op(op, left.value._long, right.value._long,
+                       &out->value._long)) {
+      return "Division by zero";
+    }
+  } else if (left.type == EVAL_F64 && right.type == EVAL_F64) {
+    *out = (Value){.type = EVAL_F64};
+    apply_double_op(op, left.value._double, right.value._double,
+                    &out->value._double);
+  } else {
+    return "Operands must have the same numeric type";
+  }
+  return NULL;
+}
+
+// Checks the arguments of a call against the function and makes the frame
+// its body is evaluated in.
+static char *enter_call(Value func, Value *args, int argc, EvalFrame **frame,
+                        Arena *arena) {
+  if (func.type != EVAL_FUNC) {
+    return "Can't call a value that isn't a function";
+  }
+  FuncExpr *funcExpr = func.value.closure.func;
+  if (argc != funcExpr->argc) {
+    return "Wrong number of arguments";
+  }
+  for (int i = 0; i < argc; i++) {
+    Type type = parse_type(funcExpr->args[i].type);
+    if ((type.type == TYPE_I32 && args[i].type != EVAL_I32) ||
+        (type.type == TYPE_F32 && args[i].type != EVAL_F32) ||
+        (type.type == TYPE_I64 && args[i].type != EVAL_I64) ||
+        (type.type == TYPE_F64 && args[i].type != EVAL_F64)) {
+      return "Argument doesn't match its declared type";
+    }
+  }
+
+  *frame = arena_alloc(arena, sizeof(EvalFrame));
+  **frame = (EvalFrame){
+      .func = funcExpr, .args = args, .parent = func.value.closure.frame};
+  return NULL;
+}
+
+// An operation, block or call whose children are being evaluated. A call's
+// children are its callee, its arguments and then the body it calls.
+typedef struct {
+  Expr expr;
+  EvalFrame *frame;
+  int next;        // index of the next child to evaluate
+  Value left;      // operation: the left operand
+  Value last;      // the child evaluated last
+  Value func;      // call: the callee
+  Value *args;     // call: the arguments
+  EvalFrame *body; // call: the frame of the body, once entered
+} Task;
+
+typedef struct {
+  Task *tasks;
+  int count;
+  int capacity;
+  Arena *arena;
+} Machine;
+
+// Evaluates an expression without children into out. Any other is pushed
+// as a task and pending set.
+static char *begin_expr(Machine *m, Expr expr, EvalFrame *frame, Value *out,
+                        bool *pending) {
+  *pending = false;
+  switch (expr.type) {
+  case EXPR_NULL:
+    *out = (Value){.type = EVAL_NULL};
+    return NULL;
+  case EXPR_INT:
+    *out = (Value){.type = EVAL_I32, .value._int = expr.value._int};
+    return NULL;
+  case EXPR_FLOAT:
+    *out = (Value){.type = EVAL_F32, .value._float = expr.value._float};
+    return NULL;
+  case EXPR_LONG:
+    *out = (Value){.type = EVAL_I64, .value._long = expr.value._long};
+    return NULL;
+  case EXPR_DOUBLE:
+    *out = (Value){.type = EVAL_F64, .value._double = expr.value._double};
+    return NULL;
+  case EXPR_NAME:
+    for (EvalFrame *f = frame; f; f = f->parent) {
+      for (int i = 0; i < f->func->argc; i++) {
+        if (f->func->args[i].name == expr.value.name) {
+          *out = f->args[i];
+          return NULL;
+        }
+      }
+    }
+    return "Unknown name";
+  case EXPR_FUNC:
+    *out = (Value){.type = EVAL_FUNC,
+                   .value.closure = {.func = expr.value.func, .frame = frame}};
+    return NULL;
+  case EXPR_OP:
+    if (expr.value.op->op == OP_ASSIGN) {
+      return "Can't evaluate assignment";
+    }
+    break;
+  case EXPR_BLOCK:
+  case EXPR_CALL:
+    break;
+  default:
+    return "Can't evaluate expression";
+  }
+
+  if (m->count == m->capacity) {
+    m->capacity = m->capacity ? m->capacity * 2 : 64;
+    m->tasks = realloc(m->tasks, m->capacity * sizeof(Task));
+  }
+  Task *task = &m->tasks[m->count++];
+  *task = (Task){.expr = expr, .frame = frame, .last = {.type = EVAL_NULL}};
+  if (expr.type == EXPR_CALL) {
+    task->args = arena_alloc(m->arena, sizeof(Value) * expr.value.call->argc);
+  }
+  *pending = true;
+  return NULL;
+}
+
+// Takes the value of the child evaluated last, entering a call once its
+// callee and arguments are known.
+static char *take_value(Machine *m, Task *task, Value value) {
+  int i = task->next - 1;
+  switch (task->expr.type) {
+  case EXPR_OP:
+    if (i == 0) {
+      task->left = value;
+    } else {
+      task->last = value;
+    }
+    return NULL;
+  case EXPR_CALL: {
+    int argc = task->expr.value.call->argc;
+    if (i == 0) {
+      task->func = value;
+    } else if (i <= argc) {
+      task->args[i - 1] = value;
+    } else {
+      task->last = value;
+    }
+    return i == argc ? enter_call(task->func, task->args, argc, &task->body,
+                                  m->arena)
+                     : NULL;
+  }
+  default:
+    task->last = value;
+    return NULL;
+  }
+}
+
+// The next child of task and the frame to evaluate it in, or false once
+// all are evaluated.
+static bool next_child(Task *task, Expr *child, EvalFrame **frame) {
+  Expr expr = task->expr;
+  *frame = task->frame;
+  switch (expr.type) {
+  case EXPR_OP:
+    if (task->next == 2) {
+      return false;
+    }
+    *child = task->next ? expr.value.op->right : expr.value.op->left;
+    break;
+  case EXPR_BLOCK:
+    if (task->next == expr.value.block->stmtc) {
+      return false;
+    }
+    *child = expr.value.block->stmts[task->next];
+    break;
+  default: {
+    CallExpr *call = expr.value.call;
+    if (task->next == call->argc + 2) {
+      return false;
+    }
+    if (task->next == 0) {
+      *child = call->func;
+    } else if (task->next <= call->argc) {
+      *child = call->args[task->next - 1];
+    } else {
+      *child = task->func.value.closure.func->body;
+      *frame = task->body;
+    }
+    break;
+  }
+  }
+  task->next++;
+  return true;
+}
+
+// The value of a task whose children are all evaluated.
+static char *finish_task(Task *task, Value *out) {
+  switch (task->expr.type) {
+  case EXPR_OP:
+    return apply_operation(task->expr.value.op->op, task->left, task->last,
+                           out);
+  case EXPR_BLOCK:
+    *out = task->expr.value.block->returns ? task->last
+                                           : (Value){.type = EVAL_NULL};
+    return NULL;
+  default:
+    *out = task->last;
+    return NULL;
+  }
+}
+
+char *eval_expr(Expr expr, EvalFrame *frame, Value *out, Arena *arena) {
+  // an explicit stack rather than recursion, so deep trees and call chains
+  // can't overflow the C stack
+  Machine m = {.arena = arena};
+  bool pending;
+  char *error = begin_expr(&m, expr, frame, out, &pending);
+  while (!error && m.count > 0) {
+    Task *task = &m.tasks[m.count - 1];
+    if (!pending) {
+      error = take_value(&m, task, *out);
+    }
+    Expr child;
+    EvalFrame *childFrame;
+    if (error) {
+      break;
+    } else if (next_child(task, &child, &childFrame)) {
+      error = begin_expr(&m, child, childFrame, out, &pending);
+    } else {
+      error = finish_task(task, out);
+      pending = false;
+      m.count--;
+    }
+  }
+  free(m.tasks);
+  return error;
+}
+
+char *eval_call(Value func, Value *args, int argc, Value *out, Arena *arena) {
+  EvalFrame *frame;
+  char *error = enter_call(func, args, argc, &frame, arena);
+  if (error) {
+    return error;
+  }
+  return eval_expr(func.value.closure.func->body, frame, out, arena);
+}
+
+char *eval_source(const char *source, size_t len, Value *args, int argc,
+                  Value *out, Arena *arena) {
+  TokenStream tokens = {0};
+  char *error = tokenize(&tokens, source, len, arena);
+  if (error) {
+    return error;
+  }
+  // a trailing top level semicolon is allowed, as when compiling
+  int end = tokens.length;
+  if (end > 0 && tokens.kinds[end - 1] == TT_SEMICOLON) {
+    end--;
+  }
+  Expr expr = {.type = EXPR_NULL};
+  error = parse(&expr, &tokens, (TokenSlice){0, end}, arena);
+  if (error) {
+    return error;
+  }
+  error = eval_expr(expr, NULL, out, arena);
+  if (error || out->type != EVAL_FUNC) {
+    return error;
+  }
+  return eval_call(*out, args, argc, out, arena);
+}
+
+bool parse_value(const char *text, size_t len, Value *out) {
+  bool negative = len > 0 && text[0] == '-';
+  size_t end;
+  Number number;
+  if (len == negative || parse_number(text, negative, len, &number, &end) ||
+      end != len) {
+    return false;
+  }
+  switch (number.type) {
+  case NUMBER_I32:
+    *out = (Value){.type = EVAL_I32, .value._int = number.value.i32};
+    if (negative) {
+      out->value._int = -out->value._int;
+    }
+    break;
+  case NUMBER_I64:
+    *out = (Value){.type = EVAL_I64, .value._long = number.value.i64};
+    if (negative) {
+      out->value._long = -out->value._long;
+    }
+    break;
+  case NUMBER_F32:
+    *out = (Value){.type = EVAL_F32, .value._float = number.value.f32};
+    if (negative) {
+      out->value._float = -out->value._float;
+    }
+    break;
+  case NUMBER_F64:
+    *out = (Value){.type = EVAL_F64, .value._double = number.value.f64};
+    if (negative) {
+      out->value._double = -out->value._double;
+    }
+    break;
+  }
+  return true;
+}
+
+void format_value(StringBuilder *sb, Value value) {
+  switch (value.type) {
+  case EVAL_NULL:
+    sb_write(sb, "NULL");
+    break;
+  case EVAL_I32:
+    sb_append_int(sb, value.value._int);
+    break;
+  case EVAL_F32:
+    sb_printf(sb, "%f", value.value._float);
+    break;
+  case EVAL_I64:
+    sb_printf(sb, "%lld", (long long)value.value._long);
+    break;
+  case EVAL_F64:
+    sb_printf(sb, "%f", value.value._double);
+    break;
+  case EVAL_FUNC:
+    sb_write(sb, "<function>");
+    break;
+  }
+}
+
+void print_value(Value value) {
+  StringBuilder sb = {0};
+  format_value(&sb, value);
+  fputs(sb.data, stdout);
+  free(sb.data);
+}
@@ -0,0 +1,47 @@
+#ifndef EVAL_H
+#define EVAL_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "parser.h"
+#include "sb.h"
+
+typedef struct EvalFrame EvalFrame;
+
+typedef struct {
+  enum { EVAL_NULL, EVAL_I32, EVAL_F32, EVAL_I64, EVAL_F64, EVAL_FUNC } type;
+  union {
+    int _int;
+    float _float;
+    int64_t _long;
+    double _double;
+    struct {
+      FuncExpr *func;
+      EvalFrame *frame; // arguments visible where the function was made
+    } closure;
+  } value;
+} Value;
+
+// Evaluates expr directly, without generating code. Names resolve to the
+// arguments of the enclosing calls in frame, which may be NULL.
+char *eval_expr(Expr expr, EvalFrame *frame, Value *out, Arena *arena);
+
+// Calls a function value with the given arguments.
+char *eval_call(Value func, Value *args, int argc, Value *out, Arena *arena);
+
+// Tokenizes, parses and evaluates source in one go. When the program is a
+// function it is called with args. The result may refer into arena.
+char *eval_source(const char *source, size_t len, Value *args, int argc,
+                  Value *out, Arena *arena);
+
+// Reads an argument written like a literal, optionally negated. Returns
+// false unless text[0, len) is exactly one value.
+bool parse_value(const char *text, size_t len, Value *out);
+
+void format_value(StringBuilder *sb, Value value);
+
+void print_value(Value value);
+
+#endif
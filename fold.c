@@ -0,0 +1,98 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "ast.h"
+#include "fold.h"
+#include "operator.h"
+
+static bool is_literal(uint8_t kind) {
+  return kind == NODE_INT || kind == NODE_FLOAT || kind == NODE_LONG ||
+         kind == NODE_DOUBLE;
+}
+
+// Folds an operation on two literals of the same kind into the literal's
+// payload, or returns false when it can't be evaluated.
+static bool fold_operation(Ast *ast, NodeId node, uint32_t *out,
+                           Arena *arena) {
+  Operator op = ast->ops[node];
+  NodeId left = ast->lhs[node];
+  NodeId right = ast->rhs[node];
+  switch (ast->kinds[left]) {
+  case NODE_INT: {
+    int value;
+    if (!apply_int_op(op, (int)ast->lhs[left], (int)ast->lhs[right], &value)) {
+      return false;
+    }
+    *out = (uint32_t)value;
+    return true;
+  }
+  case NODE_FLOAT: {
+    float a, b, value;
+    memcpy(&a, &ast->lhs[left], sizeof(a));
+    memcpy(&b, &ast->lhs[right], sizeof(b));
+    if (!apply_float_op(op, a, b, &value)) {
+      return false;
+    }
+    memcpy(out, &value, sizeof(value));
+    return true;
+  }
+  case NODE_LONG: {
+    int64_t value;
+    if (!apply_long_op(op, (int64_t)ast->literals[ast->lhs[left]],
+                       (int64_t)ast->literals[ast->lhs[right]], &value)) {
+      return false;
+    }
+    *out = ast_add_literal(ast, (uint64_t)value, arena);
+    return true;
+  }
+  case NODE_DOUBLE: {
+    double a, b, value;
+    memcpy(&a, &ast->literals[ast->lhs[left]], sizeof(a));
+    memcpy(&b, &ast->literals[ast->lhs[right]], sizeof(b));
+    if (!apply_double_op(op, a, b, &value)) {
+      return false;
+    }
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    *out = ast_add_literal(ast, bits, arena);
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+int fold_constants(Ast *ast, Arena *arena) {
+  int folded = 0;
+  // children come first, so they are already folded when a parent is seen
+  for (NodeId node = 0; node < ast->count; node++) {
+    uint8_t kind = ast->kinds[node];
+    if (kind == NODE_OP) {
+      uint8_t operand = ast->kinds[ast->lhs[node]];
+      uint32_t value;
+      if (is_literal(operand) && operand == ast->kinds[ast->rhs[node]] &&
+          fold_operation(ast, node, &value, arena)) {
+        ast->kinds[node] = operand;
+        ast->ops[node] = 0;
+        ast->lhs[node] = value;
+        ast->rhs[node] = 0;
+        folded++;
+      }
+    } else if (kind == NODE_BLOCK) {
+      const uint32_t *stmts = ast_list(ast, node);
+      bool constant = ast->ops[node] && stmts[0] > 0;
+      for (uint32_t i = 0; constant && i < stmts[0]; i++) {
+        constant = is_literal(ast->kinds[stmts[1 + i]]);
+      }
+      if (constant) {
+        NodeId last = stmts[stmts[0]];
+        ast->kinds[node] = ast->kinds[last];
+        ast->ops[node] = 0;
+        ast->lhs[node] = ast->lhs[last];
+        ast->rhs[node] = 0;
+        folded++;
+      }
+    }
+  }
+  return folded;
+}
@@ -0,0 +1,14 @@
+#ifndef FOLD_H
+#define FOLD_H
+#include "arena.h"
+#include "ast.h"
+
+// Pre-evaluates every operation whose operands are int or float literals,
+// using the same i32 wraparound, unsigned division and f32 rounding as the
+// generated code, and collapses blocks made only of literals to their last
+// value. Nodes are rewritten in place in one sweep. Must run before
+// annotate_ast_types. Returns the number of operations and blocks that were
+// replaced.
+int fold_constants(Ast *ast, Arena *arena);
+
+#endif
@@ -0,0 +1,93 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "hash.h"
+
+static const uint32_t roundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+static void compress(Sha256 *hash, const unsigned char *block) {
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++) {
+    w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 |
+           (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+  }
+  for (int i = 16; i < 64; i++) {
+    uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  uint32_t s[8];
+  memcpy(s, hash->state, sizeof(s));
+  for (int i = 0; i < 64; i++) {
+    uint32_t ch = (s[4] & s[5]) ^ (~s[4] & s[6]);
+    uint32_t t1 = s[7] + (rotr(s[4], 6) ^ rotr(s[4], 11) ^ rotr(s[4], 25)) +
+                  ch + roundConstants[i] + w[i];
+    uint32_t maj = (s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]);
+    uint32_t t2 = (rotr(s[0], 2) ^ rotr(s[0], 13) ^ rotr(s[0], 22)) + maj;
+    memmove(s + 1, s, sizeof(uint32_t) * 7);
+    s[4] += t1;
+    s[0] = t1 + t2;
+  }
+  for (int i = 0; i < 8; i++) {
+    hash->state[i] += s[i];
+  }
+}
+
+void sha256_init(Sha256 *hash) {
+  static const uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                      0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                      0x1f83d9ab, 0x5be0cd19};
+  memcpy(hash->state, initial, sizeof(initial));
+  hash->length = 0;
+}
+
+void sha256_update(Sha256 *hash, const void *data, size_t len) {
+  const unsigned char *bytes = data;
+  size_t used = hash->length % 64;
+  hash->length += len;
+  if (used) {
+    size_t take = 64 - used < len ? 64 - used : len;
+    memcpy(hash->block + used, bytes, take);
+    bytes += take;
+    len -= take;
+    if (used + take < 64) {
+      return;
+    }
+    compress(hash, hash->block);
+  }
+  for (; len >= 64; bytes += 64, len -= 64) {
+    compress(hash, bytes);
+  }
+  memcpy(hash->block, bytes, len);
+}
+
+void sha256_final(Sha256 *hash, unsigned char out[SHA256_SIZE]) {
+  uint64_t bits = hash->length * 8;
+  unsigned char pad[72] = {0x80};
+  size_t used = hash->length % 64;
+  size_t padLen = (used < 56 ? 56 : 120) - used;
+  for (int i = 0; i < 8; i++) {
+    pad[padLen + i] = (unsigned char)(bits >> (56 - i * 8));
+  }
+  sha256_update(hash, pad, padLen + 8);
+  for (int i = 0; i < 8; i++) {
+    out[i * 4] = (unsigned char)(hash->state[i] >> 24);
+    out[i * 4 + 1] = (unsigned char)(hash->state[i] >> 16);
+    out[i * 4 + 2] = (unsigned char)(hash->state[i] >> 8);
+    out[i * 4 + 3] = (unsigned char)hash->state[i];
+  }
+}
@@ -0,0 +1,20 @@
+#ifndef HASH_H
+#define HASH_H
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_SIZE 32
+
+typedef struct {
+  uint32_t state[8];
+  uint64_t length; // bytes hashed so far
+  unsigned char block[64];
+} Sha256;
+
+void sha256_init(Sha256 *hash);
+
+void sha256_update(Sha256 *hash, const void *data, size_t len);
+
+void sha256_final(Sha256 *hash, unsigned char out[SHA256_SIZE]);
+
+#endif
@@ -0,0 +1,153 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "intern.h"
+#include "memtracker.h"
+
+#define INTERN_MIN_CAPACITY 256
+#define ATOM_CHUNK_BITS 12
+#define ATOM_CHUNK_SIZE (1 << ATOM_CHUNK_BITS)
+#define ATOM_MAX_CHUNKS 4096
+
+typedef struct {
+  const char *str;
+  size_t len;
+  uint32_t hash;
+} Interned;
+
+// Atoms are stored in fixed size chunks that never move once allocated, so
+// atom_name can read them without taking the lock while other threads
+// intern new names. Everything else is guarded by internLock.
+static pthread_mutex_t internLock = PTHREAD_MUTEX_INITIALIZER;
+// Spellings live in their own arena so they outlive any one compilation.
+static Arena strings = {0};
+static Interned *chunks[ATOM_MAX_CHUNKS]; // slot 0 of chunk 0 is ATOM_NONE
+static atomic_size_t atomCount = 0;
+static Atom *table = NULL; // open addressing, 0 marks an empty slot
+static size_t tableCapacity = 0;
+
+static Interned *atom_entry(size_t atom) {
+  return &chunks[atom >> ATOM_CHUNK_BITS][atom & (ATOM_CHUNK_SIZE - 1)];
+}
+
+static uint32_t hash_str(const char *str, size_t len) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (unsigned char)str[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static void grow_table(size_t count) {
+  size_t capacity = tableCapacity ? tableCapacity * 2 : INTERN_MIN_CAPACITY;
+  Atom *grown = calloc(capacity, sizeof(Atom));
+  if (!grown) {
+    fprintf(stderr, "Interner out of memory\n");
+    abort();
+  }
+  for (size_t i = 1; i < count; i++) {
+    size_t idx = atom_entry(i)->hash & (capacity - 1);
+    while (grown[idx]) {
+      idx = (idx + 1) & (capacity - 1);
+    }
+    grown[idx] = (Atom)i;
+  }
+  free(table);
+  table = grown;
+  tableCapacity = capacity;
+}
+
+// Spellings with fixed atoms, in order after ATOM_NONE. They are interned
+// first whenever the table starts out empty.
+static const char *builtinNames[] = {"i32", "f32", "i64", "f64"};
+
+// Adds a spelling that isn't interned yet, or returns ATOM_NONE when the
+// chunks are full. Caller holds internLock.
+static Atom add_locked(const char *str, size_t len, uint32_t hash) {
+  size_t count = atomic_load_explicit(&atomCount, memory_order_relaxed);
+  if (count == 0) {
+    count = 1; // reserve ATOM_NONE
+  }
+  size_t chunk = count >> ATOM_CHUNK_BITS;
+  if (chunk >= ATOM_MAX_CHUNKS) {
+    return ATOM_NONE;
+  }
+  if (count * 2 >= tableCapacity) {
+    grow_table(count);
+  }
+  size_t mask = tableCapacity - 1;
+  size_t idx = hash & mask;
+  while (table[idx]) {
+    idx = (idx + 1) & mask;
+  }
+
+  if (!chunks[chunk]) {
+    chunks[chunk] = malloc(ATOM_CHUNK_SIZE * sizeof(Interned));
+  }
+  char *copy = arena_alloc(&strings, len + 1);
+  memcpy(copy, str, len);
+  copy[len] = '\0';
+  *atom_entry(count) = (Interned){.str = copy, .len = len, .hash = hash};
+  table[idx] = (Atom)count;
+  // publishes the entry to atom_name
+  atomic_store_explicit(&atomCount, count + 1, memory_order_release);
+  return (Atom)count;
+}
+
+Atom intern(const char *str, size_t len) {
+  uint32_t hash = hash_str(str, len);
+  pthread_mutex_lock(&internLock);
+  if (atomic_load_explicit(&atomCount, memory_order_relaxed) == 0) {
+    for (size_t i = 0; i < sizeof(builtinNames) / sizeof(*builtinNames);
+         i++) {
+      size_t builtinLen = strlen(builtinNames[i]);
+      add_locked(builtinNames[i], builtinLen,
+                 hash_str(builtinNames[i], builtinLen));
+    }
+  }
+  size_t mask = tableCapacity - 1;
+  size_t idx = hash & mask;
+  while (table[idx]) {
+    Interned *entry = atom_entry(table[idx]);
+    if (entry->hash == hash && entry->len == len &&
+        memcmp(entry->str, str, len) == 0) {
+      Atom atom = table[idx];
+      pthread_mutex_unlock(&internLock);
+      return atom;
+    }
+    idx = (idx + 1) & mask;
+  }
+  Atom atom = add_locked(str, len, hash);
+  pthread_mutex_unlock(&internLock);
+  return atom;
+}
+
+Atom intern_cstr(const char *str) { return intern(str, strlen(str)); }
+
+const char *atom_name(Atom atom) {
+  if (atom == ATOM_NONE ||
+      atom >= atomic_load_explicit(&atomCount, memory_order_acquire)) {
+    return NULL;
+  }
+  return atom_entry(atom)->str;
+}
+
+size_t atom_count(void) { return atomic_load(&atomCount); }
+
+void intern_free(void) {
+  arena_free(&strings);
+  for (size_t i = 0; i < ATOM_MAX_CHUNKS && chunks[i]; i++) {
+    free(chunks[i]);
+    chunks[i] = NULL;
+  }
+  free(table);
+  table = NULL;
+  atomic_store(&atomCount, 0);
+  tableCapacity = 0;
+}
@@ -0,0 +1,29 @@
+#ifndef INTERN_H
+#define INTERN_H
+#include <stddef.h>
+
+// Identifier handle; equal spellings always intern to the same atom.
+typedef unsigned int Atom;
+
+#define ATOM_NONE 0
+// Type names have fixed atoms, so they compare without interning.
+#define ATOM_I32 1
+#define ATOM_F32 2
+#define ATOM_I64 3
+#define ATOM_F64 4
+
+// Thread safe. atom_name doesn't lock, so it stays cheap for printers.
+// Returns ATOM_NONE once every atom is taken.
+Atom intern(const char *str, size_t len);
+
+Atom intern_cstr(const char *str);
+
+const char *atom_name(Atom atom);
+
+// Atoms handed out so far, counting ATOM_NONE and the fixed ones.
+size_t atom_count(void);
+
+// Releases every interned string; all atoms become invalid.
+void intern_free(void);
+
+#endif
@@ -0,0 +1,306 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arena.h"
+#include "intern.h"
+#include "ir.h"
+#include "sb.h"
+
+typedef int (*IrPass)(IrFunction *fn, Arena *arena);
+
+int ir_emit(IrFunction *fn, IrInstr instr, Arena *arena) {
+  if (fn->count == fn->capacity) {
+    int oldCapacity = fn->capacity;
+    fn->capacity = (fn->capacity + 1) * 2;
+    fn->instrs = arena_realloc(arena, fn->instrs, oldCapacity * sizeof(IrInstr),
+                               fn->capacity * sizeof(IrInstr));
+  }
+  instr.live = true;
+  fn->instrs[fn->count] = instr;
+  if (fn->blockCount) {
+    fn->blocks[fn->blockCount - 1].end = fn->count + 1;
+  }
+  return fn->count++;
+}
+
+void ir_begin_block(IrFunction *fn, Arena *arena) {
+  if (fn->blockCount == fn->blockCapacity) {
+    int oldCapacity = fn->blockCapacity;
+    fn->blockCapacity = (fn->blockCapacity + 1) * 2;
+    fn->blocks = arena_realloc(arena, fn->blocks, oldCapacity * sizeof(IrBlock),
+                               fn->blockCapacity * sizeof(IrBlock));
+  }
+  fn->blocks[fn->blockCount++] =
+      (IrBlock){.begin = fn->count, .end = fn->count};
+}
+
+static int operand_count(IrOp op) {
+  switch (op) {
+  case IR_CONST:
+  case IR_ARG:
+    return 0;
+  case IR_COPY:
+  case IR_RET:
+    return 1;
+  case IR_ADD:
+  case IR_SUB:
+  case IR_MUL:
+  case IR_DIV:
+    return 2;
+  }
+  return 0;
+}
+
+static int *operand(IrInstr *instr, int i) { return i ? &instr->b : &instr->a; }
+
+// Rewrites every operand that names a copy to the copied value.
+static int copy_propagation(IrFunction *fn, Arena *arena) {
+  (void)arena;
+  int changed = 0;
+  for (int i = 0; i < fn->count; i++) {
+    IrInstr *instr = &fn->instrs[i];
+    for (int j = 0; j < operand_count(instr->op); j++) {
+      int *ref = operand(instr, j);
+      int original = *ref;
+      while (*ref >= 0 && fn->instrs[*ref].op == IR_COPY) {
+        *ref = fn->instrs[*ref].a;
+      }
+      changed += *ref != original;
+    }
+  }
+  return changed;
+}
+
+// The immediate as raw bits; only the member the instruction uses is set.
+static uint64_t imm_bits(IrInstr *instr) {
+  uint64_t bits = 0;
+  if (instr->op == IR_ARG) {
+    return (uint32_t)instr->imm.arg;
+  }
+  if (instr->op != IR_CONST) {
+    return 0;
+  }
+  switch ((IrType)instr->type) {
+  case IR_I32:
+    return (uint32_t)instr->imm.i32;
+  case IR_F32:
+    memcpy(&bits, &instr->imm.f32, sizeof(float));
+    return bits;
+  case IR_I64:
+    return (uint64_t)instr->imm.i64;
+  case IR_F64:
+    memcpy(&bits, &instr->imm.f64, sizeof(double));
+    return bits;
+  case IR_VOID:
+    break;
+  }
+  return 0;
+}
+
+static uint64_t value_hash(IrInstr *instr) {
+  uint64_t hash = 1469598103934665603ULL;
+  uint64_t parts[] = {instr->op, instr->type, (uint32_t)instr->a,
+                      (uint32_t)instr->b, imm_bits(instr)};
+  for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+    hash = (hash ^ parts[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+static bool same_value(IrInstr *x, IrInstr *y) {
+  return x->op == y->op && x->type == y->type && x->a == y->a &&
+         x->b == y->b && imm_bits(x) == imm_bits(y);
+}
+
+// Hash-based value numbering. Functions have no branches, so numbering
+// over the instruction order covers the whole function.
+static int value_numbering(IrFunction *fn, Arena *arena) {
+  size_t capacity = 16;
+  while (capacity < (size_t)fn->count * 2) {
+    capacity *= 2;
+  }
+  int *table = arena_alloc(arena, sizeof(int) * capacity);
+  memset(table, -1, sizeof(int) * capacity);
+  int *leader = arena_alloc(arena, sizeof(int) * (fn->count + 1));
+
+  int changed = 0;
+  for (int i = 0; i < fn->count; i++) {
+    IrInstr *instr = &fn->instrs[i];
+    leader[i] = i;
+    if (!instr->live) {
+      continue;
+    }
+    for (int j = 0; j < operand_count(instr->op); j++) {
+      int *ref = operand(instr, j);
+      if (*ref >= 0 && leader[*ref] != *ref) {
+        *ref = leader[*ref];
+        changed++;
+      }
+    }
+    if (instr->op == IR_RET || instr->op == IR_COPY) {
+      continue;
+    }
+    if ((instr->op == IR_ADD || instr->op == IR_MUL) && instr->a > instr->b) {
+      int swap = instr->a;
+      instr->a = instr->b;
+      instr->b = swap;
+    }
+
+    size_t slot = value_hash(instr) & (capacity - 1);
+    while (table[slot] >= 0 && !same_value(&fn->instrs[table[slot]], instr)) {
+      slot = (slot + 1) & (capacity - 1);
+    }
+    if (table[slot] >= 0) {
+      leader[i] = table[slot];
+    } else {
+      table[slot] = i;
+    }
+  }
+  return changed;
+}
+
+static int dead_code_elimination(IrFunction *fn, Arena *arena) {
+  (void)arena;
+  bool *wasLive = arena_alloc(arena, sizeof(bool) * (fn->count + 1));
+  for (int i = 0; i < fn->count; i++) {
+    wasLive[i] = fn->instrs[i].live;
+    fn->instrs[i].live = fn->instrs[i].op == IR_RET;
+  }
+  for (int i = fn->count - 1; i >= 0; i--) {
+    IrInstr *instr = &fn->instrs[i];
+    if (!instr->live) {
+      continue;
+    }
+    for (int j = 0; j < operand_count(instr->op); j++) {
+      int ref = *operand(instr, j);
+      if (ref >= 0) {
+        fn->instrs[ref].live = true;
+      }
+    }
+  }
+  int removed = 0;
+  for (int i = 0; i < fn->count; i++) {
+    removed += wasLive[i] && !fn->instrs[i].live;
+  }
+  return removed;
+}
+
+static const struct {
+  const char *name;
+  IrPass run;
+} passes[] = {
+    {"copy propagation", copy_propagation},
+    {"value numbering", value_numbering},
+    {"dead code elimination", dead_code_elimination},
+};
+
+int ir_optimize(IrFunction *fn, Arena *arena, bool verbose) {
+  int total = 0;
+  for (size_t i = 0; i < sizeof(passes) / sizeof(passes[0]); i++) {
+    int changed = passes[i].run(fn, arena);
+    if (verbose) {
+      fprintf(stderr, "%s: %d changed\n", passes[i].name, changed);
+    }
+    total += changed;
+  }
+  return total;
+}
+
+static const char *ir_type_name(IrType type) {
+  switch (type) {
+  case IR_I32:
+    return "i32";
+  case IR_F32:
+    return "float";
+  case IR_I64:
+    return "i64";
+  case IR_F64:
+    return "double";
+  case IR_VOID:
+    break;
+  }
+  return "void";
+}
+
+static bool is_float(IrType type) { return type == IR_F32 || type == IR_F64; }
+
+static void print_operand(StringBuilder *sb, IrFunction *fn, int *names,
+                          int ref) {
+  IrInstr *instr = &fn->instrs[ref];
+  switch ((IrOp)instr->op) {
+  case IR_CONST:
+    if (is_float(instr->type)) {
+      // LLVM wants float constants as the bits of the equivalent double
+      double value = instr->type == IR_F32 ? instr->imm.f32 : instr->imm.f64;
+      uint64_t bits;
+      memcpy(&bits, &value, sizeof(bits));
+      sb_printf(sb, "0x%016llX", (unsigned long long)bits);
+    } else if (instr->type == IR_I64) {
+      sb_printf(sb, "%lld", (long long)instr->imm.i64);
+    } else {
+      sb_append_int(sb, instr->imm.i32);
+    }
+    break;
+  case IR_ARG:
+    sb_printf(sb, "%%%s", atom_name(fn->argNames[instr->imm.arg]));
+    break;
+  default:
+    sb_append_n(sb, "%", 1);
+    sb_append_int(sb, names[ref]);
+    break;
+  }
+}
+
+void ir_print(StringBuilder *sb, IrFunction *fn, const char *name,
+              Arena *arena) {
+  sb_printf(sb, "define %s @%s(", ir_type_name(fn->returnType), name);
+  for (int i = 0; i < fn->argc; i++) {
+    sb_printf(sb, "%s%s %%%s", i ? ", " : "", ir_type_name(fn->argTypes[i]),
+              atom_name(fn->argNames[i]));
+  }
+  sb_write(sb, ") {\n");
+
+  // unnamed values are numbered in order; %0 is the entry block
+  int *names = arena_alloc(arena, sizeof(int) * (fn->count + 1));
+  int next = 1;
+  for (int i = 0; i < fn->count; i++) {
+    IrInstr *instr = &fn->instrs[i];
+    if (!instr->live || instr->op == IR_CONST || instr->op == IR_ARG) {
+      continue;
+    }
+    switch ((IrOp)instr->op) {
+    case IR_RET:
+      sb_printf(sb, "  ret %s ", ir_type_name(fn->returnType));
+      print_operand(sb, fn, names, instr->a);
+      sb_write(sb, "\n");
+      break;
+    case IR_COPY:
+      // only reachable without copy propagation; fold into an add of zero
+      names[i] = next++;
+      sb_printf(sb, "  %%%d = %s %s ", names[i],
+                is_float(instr->type) ? "fadd" : "add",
+                ir_type_name(instr->type));
+      print_operand(sb, fn, names, instr->a);
+      sb_write(sb, is_float(instr->type) ? ", 0.0\n" : ", 0\n");
+      break;
+    default: {
+      static const char *intOps[] = {[IR_ADD] = "add", [IR_SUB] = "sub",
+                                     [IR_MUL] = "mul", [IR_DIV] = "udiv"};
+      static const char *floatOps[] = {[IR_ADD] = "fadd", [IR_SUB] = "fsub",
+                                       [IR_MUL] = "fmul", [IR_DIV] = "fdiv"};
+      names[i] = next++;
+      sb_printf(sb, "  %%%d = %s %s ", names[i],
+                is_float(instr->type) ? floatOps[instr->op] : intOps[instr->op],
+                ir_type_name(instr->type));
+      print_operand(sb, fn, names, instr->a);
+      sb_write(sb, ", ");
+      print_operand(sb, fn, names, instr->b);
+      sb_write(sb, "\n");
+      break;
+    }
+    }
+  }
+  sb_write(sb, "}\n");
+}
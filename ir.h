@@ -0,0 +1,71 @@
+#ifndef IR_H
+#define IR_H
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "intern.h"
+#include "sb.h"
+
+typedef enum {
+  IR_CONST,
+  IR_ARG,
+  IR_COPY, // a
+  IR_ADD,  // a, b
+  IR_SUB,
+  IR_MUL,
+  IR_DIV,
+  IR_RET, // a
+} IrOp;
+
+typedef enum { IR_VOID, IR_I32, IR_F32, IR_I64, IR_F64 } IrType;
+
+// One SSA value. Operands are indices of earlier instructions in the same
+// function; constants and arguments are instructions too, printed inline.
+typedef struct {
+  uint8_t op;
+  uint8_t type;
+  bool live; // cleared by dead code elimination
+  int a;
+  int b;
+  union {
+    int32_t i32;
+    float f32;
+    int64_t i64;
+    double f64;
+    int arg;
+  } imm;
+} IrInstr;
+
+// Range of instructions ending in a terminator.
+typedef struct {
+  int begin;
+  int end;
+} IrBlock;
+
+typedef struct {
+  IrInstr *instrs;
+  int count;
+  int capacity;
+  IrBlock *blocks;
+  int blockCount;
+  int blockCapacity;
+  Atom *argNames;
+  IrType *argTypes;
+  int argc;
+  IrType returnType;
+} IrFunction;
+
+int ir_emit(IrFunction *fn, IrInstr instr, Arena *arena);
+
+// Starts a new basic block at the next instruction.
+void ir_begin_block(IrFunction *fn, Arena *arena);
+
+// Runs copy propagation, value numbering and dead code elimination, and
+// returns the number of instructions each pass changed in total.
+int ir_optimize(IrFunction *fn, Arena *arena, bool verbose);
+
+void ir_print(StringBuilder *sb, IrFunction *fn, const char *name,
+              Arena *arena);
+
+#endif
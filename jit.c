@@ -0,0 +1,255 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "arena.h"
+#include "bytecode.h"
+#include "jit.h"
+#include "parser.h"
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Each bytecode register becomes a 4 byte stack slot at [rsp + 4 * r], so
+// the translation is one short instruction sequence per bytecode
+// instruction. rdi holds args and rsi out on entry; out is spilled above
+// the register slots so calls can reuse both.
+
+typedef struct {
+  unsigned char *bytes;
+  size_t length;
+  size_t capacity;
+  Arena *arena;
+} CodeBuffer;
+
+typedef struct {
+  size_t at; // offset of the rel32 to patch
+  int target;
+} Fixup;
+
+static void put(CodeBuffer *buf, const void *data, size_t len) {
+  if (buf->length + len > buf->capacity) {
+    size_t oldCapacity = buf->capacity;
+    buf->capacity = (buf->capacity + len) * 2;
+    buf->bytes =
+        arena_realloc(buf->arena, buf->bytes, oldCapacity, buf->capacity);
+  }
+  memcpy(buf->bytes + buf->length, data, len);
+  buf->length += len;
+}
+
+static void put_u8(CodeBuffer *buf, unsigned char byte) { put(buf, &byte, 1); }
+
+static void put_u32(CodeBuffer *buf, uint32_t value) {
+  put(buf, &value, sizeof(value));
+}
+
+static void patch_rel32(CodeBuffer *buf, size_t at, size_t target) {
+  int32_t rel = (int32_t)((int64_t)target - (int64_t)(at + 4));
+  memcpy(buf->bytes + at, &rel, sizeof(rel));
+}
+
+// Emits opcode bytes followed by a [rsp + disp32] memory operand with the
+// given register in the ModRM reg field.
+static void put_rsp_operand(CodeBuffer *buf, const unsigned char *opcode,
+                            size_t opcodeLen, int reg, int32_t disp) {
+  put(buf, opcode, opcodeLen);
+  put_u8(buf, (unsigned char)(0x84 | (reg << 3))); // mod=10 rm=100 (SIB)
+  put_u8(buf, 0x24);                                // base=rsp, no index
+  put_u32(buf, (uint32_t)disp);
+}
+
+#define RAX 0
+#define RCX 1
+#define RSI 6
+#define RDI 7
+#define XMM0 0
+
+static void load_eax(CodeBuffer *buf, int slot) {
+  put_rsp_operand(buf, (unsigned char[]){0x8b}, 1, RAX, slot * 4);
+}
+
+static void store_eax(CodeBuffer *buf, int slot) {
+  put_rsp_operand(buf, (unsigned char[]){0x89}, 1, RAX, slot * 4);
+}
+
+static void emit_chunk(CodeBuffer *buf, Chunk *chunk, Fixup **calls,
+                       int *callCount, int *callCapacity) {
+  // keep rsp 16 byte aligned at call sites: entry has rsp = 8 (mod 16)
+  int32_t outSlot = (chunk->regCount * 4 + 7) & ~7;
+  int32_t frame = outSlot + 8;
+  if (frame % 16 != 8) {
+    frame += 8;
+  }
+
+  put(buf, (unsigned char[]){0x48, 0x81, 0xec}, 3); // sub rsp, frame
+  put_u32(buf, (uint32_t)frame);
+  put_rsp_operand(buf, (unsigned char[]){0x48, 0x89}, 2, RSI, outSlot);
+
+  for (int i = 0; i < chunk->argc; i++) {
+    put(buf, (unsigned char[]){0x8b, 0x87}, 2); // mov eax, [rdi + disp32]
+    put_u32(buf, (uint32_t)(i * 4));
+    store_eax(buf, i);
+  }
+  int constBase = chunk->argc + chunk->tempCount;
+  for (int i = 0; i < chunk->constantCount; i++) {
+    // mov dword [rsp + disp32], imm32
+    put_rsp_operand(buf, (unsigned char[]){0xc7}, 1, 0, (constBase + i) * 4);
+    put(buf, &chunk->constants[i], 4);
+  }
+
+  Fixup failJumps[chunk->codeLength + 1];
+  int failCount = 0;
+  Fixup divJumps[chunk->codeLength + 1];
+  int divCount = 0;
+
+  for (int i = 0; i < chunk->codeLength; i++) {
+    Instr in = chunk->code[i];
+    switch ((Opcode)in.op) {
+    case BC_MOV:
+      load_eax(buf, in.a);
+      store_eax(buf, in.dst);
+      break;
+    case BC_ADD_I32:
+    case BC_SUB_I32:
+    case BC_MUL_I32: {
+      load_eax(buf, in.a);
+      if (in.op == BC_ADD_I32) {
+        put_rsp_operand(buf, (unsigned char[]){0x03}, 1, RAX, in.b * 4);
+      } else if (in.op == BC_SUB_I32) {
+        put_rsp_operand(buf, (unsigned char[]){0x2b}, 1, RAX, in.b * 4);
+      } else {
+        put_rsp_operand(buf, (unsigned char[]){0x0f, 0xaf}, 2, RAX, in.b * 4);
+      }
+      store_eax(buf, in.dst);
+      break;
+    }
+    case BC_DIV_I32:
+      load_eax(buf, in.a);
+      put_rsp_operand(buf, (unsigned char[]){0x8b}, 1, RCX, in.b * 4);
+      put(buf, (unsigned char[]){0x85, 0xc9}, 2);       // test ecx, ecx
+      put(buf, (unsigned char[]){0x0f, 0x84}, 2);       // jz div_zero
+      divJumps[divCount++] = (Fixup){.at = buf->length};
+      put_u32(buf, 0);
+      put(buf, (unsigned char[]){0x31, 0xd2, 0xf7, 0xf1}, 4); // xor edx; div ecx
+      store_eax(buf, in.dst);
+      break;
+    case BC_ADD_F32:
+    case BC_SUB_F32:
+    case BC_MUL_F32:
+    case BC_DIV_F32: {
+      static const unsigned char ops[] = {
+          [BC_ADD_F32 - BC_ADD_F32] = 0x58, [BC_SUB_F32 - BC_ADD_F32] = 0x5c,
+          [BC_MUL_F32 - BC_ADD_F32] = 0x59, [BC_DIV_F32 - BC_ADD_F32] = 0x5e};
+      put_rsp_operand(buf, (unsigned char[]){0xf3, 0x0f, 0x10}, 3, XMM0,
+                      in.a * 4);
+      put_rsp_operand(buf,
+                      (unsigned char[]){0xf3, 0x0f, ops[in.op - BC_ADD_F32]},
+                      3, XMM0, in.b * 4);
+      put_rsp_operand(buf, (unsigned char[]){0xf3, 0x0f, 0x11}, 3, XMM0,
+                      in.dst * 4);
+      break;
+    }
+    case BC_CALL:
+      put_rsp_operand(buf, (unsigned char[]){0x48, 0x8d}, 2, RDI, in.b * 4);
+      put_rsp_operand(buf, (unsigned char[]){0x48, 0x8d}, 2, RSI, in.dst * 4);
+      put_u8(buf, 0xe8); // call rel32
+      if (*callCount == *callCapacity) {
+        int oldCapacity = *callCapacity;
+        *callCapacity = (*callCapacity + 1) * 2;
+        *calls = arena_realloc(buf->arena, *calls, oldCapacity * sizeof(Fixup),
+                               *callCapacity * sizeof(Fixup));
+      }
+      (*calls)[(*callCount)++] = (Fixup){.at = buf->length, .target = in.a};
+      put_u32(buf, 0);
+      put(buf, (unsigned char[]){0x85, 0xc0}, 2); // test eax, eax
+      put(buf, (unsigned char[]){0x0f, 0x85}, 2); // jnz fail
+      failJumps[failCount++] = (Fixup){.at = buf->length};
+      put_u32(buf, 0);
+      break;
+    case BC_RET:
+      load_eax(buf, in.a);
+      put_rsp_operand(buf, (unsigned char[]){0x48, 0x8b}, 2, RCX, outSlot);
+      put(buf, (unsigned char[]){0x89, 0x01}, 2); // mov [rcx], eax
+      put(buf, (unsigned char[]){0x31, 0xc0}, 2); // xor eax, eax
+      put(buf, (unsigned char[]){0x48, 0x81, 0xc4}, 3); // add rsp, frame
+      put_u32(buf, (uint32_t)frame);
+      put_u8(buf, 0xc3);
+      break;
+    }
+  }
+
+  // div_zero: eax = 1, then fall into fail, which returns eax as is
+  size_t divZero = buf->length;
+  put(buf, (unsigned char[]){0xb8, 1, 0, 0, 0}, 5);
+  size_t fail = buf->length;
+  put(buf, (unsigned char[]){0x48, 0x81, 0xc4}, 3);
+  put_u32(buf, (uint32_t)frame);
+  put_u8(buf, 0xc3);
+
+  for (int i = 0; i < divCount; i++) {
+    patch_rel32(buf, divJumps[i].at, divZero);
+  }
+  for (int i = 0; i < failCount; i++) {
+    patch_rel32(buf, failJumps[i].at, fail);
+  }
+}
+
+char *jit_compile(JitCode *code, FuncExpr *func, Arena *arena) {
+  BytecodeModule module = {0};
+  int entry;
+  char *error = lower_function(&module, func, &entry, arena);
+  if (error) {
+    return error;
+  }
+
+  CodeBuffer buf = {.arena = arena};
+  size_t *starts = arena_alloc(arena, sizeof(size_t) * module.chunkCount);
+  Fixup *calls = NULL;
+  int callCount = 0;
+  int callCapacity = 0;
+  for (int i = 0; i < module.chunkCount; i++) {
+    starts[i] = buf.length;
+    emit_chunk(&buf, &module.chunks[i], &calls, &callCount, &callCapacity);
+  }
+  for (int i = 0; i < callCount; i++) {
+    patch_rel32(&buf, calls[i].at, starts[calls[i].target]);
+  }
+
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t size = (buf.length + page - 1) & ~(page - 1);
+  void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    return "Failed to map memory for JIT code";
+  }
+  memcpy(memory, buf.bytes, buf.length);
+  if (mprotect(memory, size, PROT_READ | PROT_EXEC)) {
+    munmap(memory, size);
+    return "Failed to make JIT code executable";
+  }
+
+  *code = (JitCode){.memory = memory, .size = size};
+  code->entry = (JitFunc)((char *)memory + starts[entry]);
+  return NULL;
+}
+
+void jit_free(JitCode *code) {
+  if (code->memory) {
+    munmap(code->memory, code->size);
+  }
+  *code = (JitCode){0};
+}
+
+#else
+
+char *jit_compile(JitCode *code, FuncExpr *func, Arena *arena) {
+  (void)func;
+  (void)arena;
+  *code = (JitCode){0};
+  return "The JIT only supports x86-64 System V targets";
+}
+
+void jit_free(JitCode *code) { *code = (JitCode){0}; }
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef JIT_H
+#define JIT_H
+#include <stddef.h>
+
+#include "arena.h"
+#include "bytecode.h"
+#include "parser.h"
+
+// Native entry point: reads the arguments from args, stores the result in
+// out and returns 0, or returns nonzero on i32 division by zero.
+typedef int (*JitFunc)(const Reg *args, Reg *out);
+
+typedef struct {
+  void *memory;
+  size_t size;
+  JitFunc entry;
+} JitCode;
+
+// Compiles an annotated function to x86-64 code in its own mapping, which
+// is made executable only after it has been written. Supported on x86-64
+// System V targets only.
+char *jit_compile(JitCode *code, FuncExpr *func, Arena *arena);
+
+void jit_free(JitCode *code);
+
+#endif
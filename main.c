@@ -1,78 +1,473 @@
 #include <stdlib.h>
 
+#include "arena.h"
+#include "ast.h"
+#include "cache.h"
 #include "compiler.h"
+#include "eval.h"
+#include "fold.h"
+#include "intern.h"
 #include "memtracker.h"
+#include "module.h"
 #include "parser.h"
 #include "sb.h"
+#include "sink.h"
+#include "source.h"
 #include "tokeniser.h"
+#include "trace.h"
+#include "server.h"
+#include "type.h"
+#include "watch.h"
+#include <ctype.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
-#include <sys/stat.h>
 
-int main() {
-  FILE *file = fopen("main.pv", "r");
-  if (!file) {
-    fprintf(stderr, "Failed to open file\n");
-    return 1;
-  }
-  struct stat stats;
-  int err = fstat(fileno(file), &stats);
-  if (err)
-    return err;
+typedef struct {
+  bool evalMode;
+  Value *evalArgs;
+  int evalArgc;
+  bool hashCons;
+  int jobs;
+  Cache *cache; // NULL unless --cache was given
+  bool watch;
+  const char *socketPath; // --serve
+  bool wroteOutput;
+} Options;
 
-  char *buf = malloc(stats.st_size + 1);
+// Options that change the generated code, part of every cache key.
+static const char *option_key(Options *options) {
+  return options->hashCons ? "hash-cons" : "";
+}
 
-  size_t read = fread(buf, 1, stats.st_size, file);
+static CacheKey definition_key(Definition *def, TokenStream *tokens,
+                               Options *options) {
+  Span first = tokens->spans[def->tokens.begin];
+  Span last = tokens->spans[def->tokens.end - 1];
+  return cache_key(CACHE_DEFINITION, option_key(options),
+                   tokens->source + first.offset,
+                   last.offset + last.length - first.offset);
+}
 
-  buf[read] = '\0';
+static const char *copy_text(const char *text, size_t len, Arena *arena) {
+  char *copy = arena_alloc(arena, len + 1);
+  memcpy(copy, text, len);
+  copy[len] = '\0';
+  return copy;
+}
 
-  fclose(file);
+// Fills in the code of every definition with a cached fragment, stored as
+// "<decl length>\n<decl><impl>". An entry without a valid header counts as
+// a miss, and its definition is compiled and stored again.
+static void load_fragments(Module *module, TokenStream *tokens,
+                           Options *options, Arena *arena) {
+  for (int i = 0; i < module->count; i++) {
+    Definition *def = &module->defs[i];
+    Source fragment;
+    if (!cache_get(options->cache, definition_key(def, tokens, options),
+                   &fragment)) {
+      continue;
+    }
+    const char *newline = memchr(fragment.data, '\n', fragment.len);
+    char *end = NULL;
+    size_t declLength = 0;
+    // strtoul stops at the newline, and the leading digit rules out the
+    // whitespace and sign it would otherwise skip
+    if (newline && isdigit((unsigned char)fragment.data[0])) {
+      declLength = strtoul(fragment.data, &end, 10);
+    }
+    size_t header = newline ? (size_t)(newline - fragment.data) + 1 : 0;
+    if (newline && end == newline && declLength <= fragment.len - header) {
+      def->decl = copy_text(fragment.data + header, declLength, arena);
+      def->impl = copy_text(fragment.data + header + declLength,
+                            fragment.len - header - declLength, arena);
+    } else {
+      options->cache->hits--;
+      options->cache->misses++;
+    }
+    source_close(&fragment);
+  }
+}
 
-  TokenVec tokens = tokenize(buf, read);
+static void store_fragments(Module *module, TokenStream *tokens,
+                            Options *options) {
+  for (int i = 0; i < module->count; i++) {
+    Definition *def = &module->defs[i];
+    StringBuilder fragment = {0};
+    sb_printf(&fragment, "%zu\n%s%s", strlen(def->decl), def->decl,
+              def->impl);
+    cache_put(options->cache, definition_key(def, tokens, options),
+              fragment.data, fragment.length);
+    free(fragment.data);
+  }
+}
 
-  free(buf);
+// Tokenizes and parses the source, then evaluates or compiles it to out.ll.
+static int run(Source *source, Options *options, Arena *arena) {
+  TokenStream tokens = {0};
+  trace_begin("tokenize", NULL);
+  char *error = tokenize(&tokens, source->data, source->len, arena);
+  trace_end();
+  trace_count("tokens", tokens.length);
+  if (error) {
+    printf("Error: %s\n", error);
+    return 1;
+  }
 
   // for (int i = 0; i < tokens.length; i++) {
-  //   print_token(tokens.tokens[i]);
+  //   print_token(&tokens, i);
   // }
 
   // return 0;
 
-  Expr expr = {.type = EXPR_NULL, .value = NULL};
-  char *error = parse(&expr, tokens, true);
+  // a module is a list of named definitions; otherwise the whole file is
+  // one expression, main
+  Module module = {0};
+  bool moduleMode = is_module(&tokens);
+  Expr expr = {.type = EXPR_NULL};
+  Ast ast = {0};
+  trace_begin("parse", NULL);
+  if (moduleMode) {
+    error = parse_module(&module, &tokens, options->hashCons, arena);
+  } else {
+    int end = tokens.length;
+    if (end > 0 && tokens.kinds[end - 1] == TT_SEMICOLON) {
+      end--;
+    }
+    error = (options->hashCons ? parse_shared : parse)(
+        &expr, &tokens, (TokenSlice){0, end}, arena);
+    if (!error) {
+      ast_build(&ast, expr, options->hashCons, arena);
+    }
+  }
+  trace_end();
   if (error) {
     printf("Error: %s\n", error);
     return 1;
   }
 
-  print_expr(expr);
+  if (tracing()) {
+    long nodes = ast.count;
+    for (int i = 0; i < module.count; i++) {
+      nodes += module.defs[i].ast.count;
+    }
+    trace_count("ast nodes", nodes);
+  }
+
+  if (options->evalMode) {
+    if (moduleMode) {
+      Atom mainName = intern_cstr("main");
+      for (int i = 0; i < module.count; i++) {
+        if (module.defs[i].name == mainName) {
+          expr = module.defs[i].func;
+        }
+      }
+    }
+    Value result;
+    trace_begin("eval", NULL);
+    error = eval_expr(expr, NULL, &result, arena);
+    if (!error && result.type == EVAL_FUNC) {
+      error = eval_call(result, options->evalArgs, options->evalArgc, &result,
+                        arena);
+    }
+    trace_end();
+    if (error) {
+      printf("Error: %s\n", error);
+      return 1;
+    }
+    print_value(result);
+    printf("\n");
+    return 0;
+  }
+
+  if (moduleMode) {
+    int folded = 0;
+    for (int i = 0; i < module.count; i++) {
+      printf("%s = ", atom_name(module.defs[i].name));
+      ast_print(&module.defs[i].ast, ast_root(&module.defs[i].ast));
+      printf(";\n");
+      trace_begin("fold", atom_name(module.defs[i].name));
+      folded += fold_constants(&module.defs[i].ast, arena);
+      trace_end();
+    }
+    if (folded) {
+      printf("Folded %d constant expressions\n", folded);
+    }
+
+    if (options->cache) {
+      trace_begin("cache", NULL);
+      load_fragments(&module, &tokens, options, arena);
+      trace_end();
+    }
+    OutputSink sink;
+    if (sink_open(&sink, "out.ll")) {
+      printf("Failed to open out.ll");
+      return 1;
+    }
+    int failed;
+    error = compile_module(&sink.decl, &sink.body, &module, options->jobs,
+                           &failed, arena);
+    if (error) {
+      printf("Error in %s: %s\n", atom_name(module.defs[failed].name), error);
+      sink_discard(&sink);
+      return 1;
+    }
+    if (options->cache) {
+      trace_begin("cache", NULL);
+      store_fragments(&module, &tokens, options);
+      trace_end();
+    }
+    trace_begin("write", NULL);
+    error = sink_close(&sink);
+    trace_end();
+    if (error) {
+      printf("Error: %s\n", error);
+      return 1;
+    }
+    options->wroteOutput = true;
+    return 0;
+  }
+
+  NodeId root = ast_root(&ast);
+  ast_print(&ast, root);
   printf("\n");
 
-  if (expr.type == EXPR_FUNC) {
-    StringBuilder impl = {0};
-    StringBuilder decl = {0};
-    compile_function(&decl, &impl, *expr.value.func, "main");
-    StringBuilder outBuilder = {0};
-    char *declStr = sb_to_string(&decl, true);
-    char *implStr = sb_to_string(&impl, true);
-    sb_write(&outBuilder, declStr);
-    sb_write(&outBuilder, implStr);
-    free(declStr);
-    free(implStr);
-    FILE *outFile = fopen("out.ll", "w");
-    if (file == NULL) {
+  trace_begin("fold", NULL);
+  int folded = fold_constants(&ast, arena);
+  trace_end();
+  if (folded) {
+    printf("Folded %d constant expressions\n", folded);
+  }
+
+  trace_begin("type", NULL);
+  error = annotate_ast_types(&ast);
+  trace_end();
+  if (error) {
+    printf("Error: %s\n", error);
+    return 1;
+  }
+
+  if (ast.kinds[root] == NODE_FUNC) {
+    if (ast.types[ast.lhs[root]] == TYPE_NULL) {
+      printf("Error: Can't infer the return type of main\n");
+      return 1;
+    }
+    OutputSink sink;
+    if (sink_open(&sink, "out.ll")) {
       printf("Failed to open out.ll");
       return 1;
     }
-    char *out = sb_to_string(&outBuilder, true);
-    fputs(out, file);
-    free(out);
+    trace_begin("codegen", NULL);
+    error = compile_function(&sink.body, &ast, root, "main", arena);
+    trace_end();
+    if (error) {
+      printf("Error: %s\n", error);
+      sink_discard(&sink);
+      return 1;
+    }
+    trace_begin("write", NULL);
+    error = sink_close(&sink);
+    trace_end();
+    if (error) {
+      printf("Error: %s\n", error);
+      return 1;
+    }
+    options->wroteOutput = true;
+  }
+  return 0;
+}
+
+// Writes out a whole cached out.ll.
+static int write_cached(Source *cached) {
+  OutputSink sink;
+  if (sink_open(&sink, "out.ll")) {
+    printf("Failed to open out.ll");
+    return 1;
+  }
+  sb_append_n(&sink.body, cached->data, cached->len);
+  char *error = sink_close(&sink);
+  if (error) {
+    printf("Error: %s\n", error);
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  Arena arena = {0};
+  Options options = {.jobs = 1};
+  const char *cacheDir = NULL;
+  size_t cacheLimit = CACHE_DEFAULT_LIMIT;
+  bool timeReport = false;
+  const char *tracePath = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--eval") == 0) {
+      // the remaining arguments are passed to main
+      options.evalMode = true;
+      options.evalArgc = argc - i - 1;
+      options.evalArgs = arena_alloc(&arena, sizeof(Value) * options.evalArgc);
+      for (int j = 0; j < options.evalArgc; j++) {
+        const char *arg = argv[i + 1 + j];
+        if (!parse_value(arg, strlen(arg), &options.evalArgs[j])) {
+          fprintf(stderr, "Invalid argument %s\n", arg);
+          return 1;
+        }
+      }
+      break;
+    } else if (strncmp(argv[i], "-j", 2) == 0) {
+      // -j N or -jN: number of threads compiling a module
+      const char *count = argv[i][2]      ? argv[i] + 2
+                          : i + 1 < argc ? argv[++i]
+                                         : "";
+      char *end;
+      options.jobs = (int)strtol(count, &end, 10);
+      if (!*count || *end || options.jobs < 1) {
+        fprintf(stderr, "Invalid job count %s\n", count);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--hash-cons") == 0) {
+      // share identical subexpressions instead of building each copy
+      options.hashCons = true;
+    } else if (strcmp(argv[i], "--watch") == 0) {
+      // recompile main.pv whenever it changes
+      options.watch = true;
+    } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+      // --serve <socket>: answer compile requests on a Unix socket with -j
+      // worker threads
+      options.socketPath = argv[++i];
+    } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+      // --cache <dir>: reuse the output of inputs compiled before
+      cacheDir = argv[++i];
+    } else if (strcmp(argv[i], "--cache-limit") == 0 && i + 1 < argc) {
+      // --cache-limit <bytes>: evict least recently used entries past this
+      char *end;
+      cacheLimit = strtoull(argv[++i], &end, 10);
+      if (*end) {
+        fprintf(stderr, "Invalid cache limit %s\n", argv[i]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--time-report") == 0) {
+      // print the time spent in each phase and a few counters
+      timeReport = true;
+    } else if (strncmp(argv[i], "--trace=", 8) == 0 && argv[i][8]) {
+      // --trace=<file.json>: write the phases as Chrome trace events
+      tracePath = argv[i] + 8;
+    } else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  // PREVAL_ALLOC_PROFILE=<file.json> enables the per call site profiler
+  char *profilePath = getenv("PREVAL_ALLOC_PROFILE");
+  if (profilePath) {
+    profile_allocations(true);
   }
 
-  free_expr(expr);
+  if (timeReport || tracePath) {
+    trace_enable();
+  }
+
+  if (options.watch) {
+    char *error = watch("main.pv", options.jobs, options.hashCons);
+    fprintf(stderr, "%s\n", error);
+    return 1;
+  }
+
+  Cache cache;
+  if (cacheDir && !options.evalMode) {
+    char *error = cache_open(&cache, cacheDir, cacheLimit);
+    if (error) {
+      fprintf(stderr, "%s\n", error);
+      return 1;
+    }
+    options.cache = &cache;
+  }
+
+  if (options.socketPath) {
+    char *error = serve(options.socketPath, options.jobs, options.cache);
+    if (options.cache) {
+      cache_evict(&cache);
+      cache_close(&cache);
+    }
+    if (error) {
+      fprintf(stderr, "%s\n", error);
+      return 1;
+    }
+    arena_free(&arena);
+    intern_free();
+    report_leaks();
+    return 0;
+  }
+
+  Source source;
+  trace_begin("read", NULL);
+  char *error = source_open(&source, "main.pv");
+  trace_end();
+  if (error) {
+    fprintf(stderr, "%s\n", error);
+    return 1;
+  }
+
+  int status;
+  if (options.cache) {
+    // an unchanged file skips every phase; a changed one is cached whole
+    // once compiled, on top of its per definition fragments
+    CacheKey key = cache_key(CACHE_FILE, option_key(&options), source.data,
+                             source.len);
+    Source cached;
+    trace_begin("cache", NULL);
+    bool hit = cache_get(&cache, key, &cached);
+    trace_end();
+    if (hit) {
+      trace_begin("write", NULL);
+      status = write_cached(&cached);
+      trace_end();
+      source_close(&cached);
+    } else {
+      status = run(&source, &options, &arena);
+      if (options.wroteOutput && source_open(&cached, "out.ll") == NULL) {
+        cache_put(&cache, key, cached.data, cached.len);
+        source_close(&cached);
+      }
+    }
+    printf("Cache: %lu hits, %lu misses\n", cache.hits, cache.misses);
+    cache_evict(&cache);
+    cache_close(&cache);
+  } else {
+    status = run(&source, &options, &arena);
+  }
+  if (timeReport) {
+    trace_report(stderr);
+  }
+  if (tracePath) {
+    error = trace_write(tracePath);
+    if (error) {
+      fprintf(stderr, "%s\n", error);
+    }
+  }
+  trace_free();
+  if (status) {
+    return status;
+  }
+
+  arena_free(&arena);
+  source_close(&source);
+  intern_free();
+
+  if (profilePath) {
+    FILE *profileFile = fopen(profilePath, "w");
+    if (!profileFile) {
+      fprintf(stderr, "Failed to open %s\n", profilePath);
+    }
+    report_allocations(stderr, profileFile);
+    if (profileFile) {
+      fclose(profileFile);
+    }
+  }
 
   report_leaks();
 
   return 0;
-}
\ No newline at end of file
+}
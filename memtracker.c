@@ -1,16 +1,208 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define TABLE_MIN_CAPACITY 256
+#define SITE_MIN_CAPACITY 64
+#define SIZE_BUCKETS 16
+
+// Live allocations are stored inline in an open-addressing table keyed by
+// pointer, so the table doubles as the pool of tracking records. Empty slots
+// have ptr == NULL; removal uses backward shifting so no tombstones build up.
 typedef struct AllocInfo {
   void *ptr;
   size_t size;
   const char *file;
   int line;
-  struct AllocInfo *next;
+  int site;            // index into sites, or -1 when not profiling
+  unsigned long birth; // allocation tick at which this block was created
 } AllocInfo;
 
-static AllocInfo *allocList = NULL;
+// Guards every table below; allocations come from compile worker threads.
+static pthread_mutex_t trackerLock = PTHREAD_MUTEX_INITIALIZER;
+
+static AllocInfo *allocTable = NULL;
+static size_t allocCapacity = 0; // always a power of two
+static size_t allocCount = 0;
+
+// Per call site aggregates for profiling mode. Lifetimes are measured in
+// allocation ticks: the number of tracked allocations made in between.
+typedef struct {
+  const char *file;
+  int line;
+  unsigned long count;
+  unsigned long freed;
+  size_t totalBytes;
+  size_t liveBytes;
+  size_t peakBytes;
+  unsigned long totalLifetime;
+  unsigned long sizes[SIZE_BUCKETS]; // bucket 0 is < 16 bytes, then powers of two
+} AllocSite;
+
+static bool profiling = false;
+static unsigned long allocTick = 0;
+static AllocSite *sites = NULL;
+static size_t siteCount = 0;
+static int *siteIndex = NULL; // slot holds site index + 1, 0 when empty
+static size_t siteCapacity = 0;
+
+static size_t hash_ptr(const void *ptr) {
+  uint64_t x = (uint64_t)(uintptr_t)ptr;
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  return (size_t)x;
+}
+
+static size_t find_slot(AllocInfo *table, size_t capacity, const void *ptr) {
+  size_t mask = capacity - 1;
+  size_t idx = hash_ptr(ptr) & mask;
+  while (table[idx].ptr && table[idx].ptr != ptr) {
+    idx = (idx + 1) & mask;
+  }
+  return idx;
+}
+
+static int table_grow(void) {
+  size_t capacity = allocCapacity ? allocCapacity * 2 : TABLE_MIN_CAPACITY;
+  AllocInfo *table = calloc(capacity, sizeof(AllocInfo));
+  if (!table) {
+    return 0;
+  }
+  for (size_t i = 0; i < allocCapacity; i++) {
+    if (allocTable[i].ptr) {
+      table[find_slot(table, capacity, allocTable[i].ptr)] = allocTable[i];
+    }
+  }
+  free(allocTable);
+  allocTable = table;
+  allocCapacity = capacity;
+  return 1;
+}
+
+static size_t hash_site(const char *file, int line) {
+  return hash_ptr(file) ^ (size_t)line * 0x9e3779b97f4a7c15ULL;
+}
+
+static int site_for(const char *file, int line) {
+  if ((siteCount + 1) * 2 > siteCapacity) {
+    size_t capacity = siteCapacity ? siteCapacity * 2 : SITE_MIN_CAPACITY;
+    int *index = calloc(capacity, sizeof(int));
+    AllocSite *grown = realloc(sites, capacity / 2 * sizeof(AllocSite));
+    if (!index || !grown) {
+      free(index);
+      if (grown) {
+        sites = grown;
+      }
+      return -1;
+    }
+    sites = grown;
+    for (size_t i = 0; i < siteCount; i++) {
+      size_t idx = hash_site(sites[i].file, sites[i].line) & (capacity - 1);
+      while (index[idx]) {
+        idx = (idx + 1) & (capacity - 1);
+      }
+      index[idx] = (int)i + 1;
+    }
+    free(siteIndex);
+    siteIndex = index;
+    siteCapacity = capacity;
+  }
+
+  size_t mask = siteCapacity - 1;
+  size_t idx = hash_site(file, line) & mask;
+  while (siteIndex[idx]) {
+    AllocSite *site = &sites[siteIndex[idx] - 1];
+    if (site->file == file && site->line == line) {
+      return siteIndex[idx] - 1;
+    }
+    idx = (idx + 1) & mask;
+  }
+  sites[siteCount] = (AllocSite){.file = file, .line = line};
+  siteIndex[idx] = (int)++siteCount;
+  return (int)siteCount - 1;
+}
+
+static int size_bucket(size_t size) {
+  int bucket = 0;
+  while (size >= 16 && bucket < SIZE_BUCKETS - 1) {
+    size >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+static void profile_alloc(AllocInfo *info) {
+  info->birth = allocTick++;
+  info->site = profiling ? site_for(info->file, info->line) : -1;
+  if (info->site < 0) {
+    return;
+  }
+  AllocSite *site = &sites[info->site];
+  site->count++;
+  site->totalBytes += info->size;
+  site->liveBytes += info->size;
+  if (site->liveBytes > site->peakBytes) {
+    site->peakBytes = site->liveBytes;
+  }
+  site->sizes[size_bucket(info->size)]++;
+}
+
+static void profile_free(AllocInfo *info) {
+  if (info->site < 0) {
+    return;
+  }
+  AllocSite *site = &sites[info->site];
+  site->freed++;
+  site->liveBytes -= info->size;
+  site->totalLifetime += allocTick - info->birth;
+}
+
+static int track(void *ptr, size_t size, const char *file, int line) {
+  // keep the load factor at or below one half so probe runs stay short
+  if ((allocCount + 1) * 2 > allocCapacity && !table_grow()) {
+    return 0;
+  }
+  size_t idx = find_slot(allocTable, allocCapacity, ptr);
+  if (!allocTable[idx].ptr) {
+    allocCount++;
+  }
+  allocTable[idx] = (AllocInfo){
+      .ptr = ptr, .size = size, .file = file, .line = line};
+  profile_alloc(&allocTable[idx]);
+  return 1;
+}
+
+static AllocInfo *lookup(const void *ptr) {
+  if (!allocCapacity) {
+    return NULL;
+  }
+  size_t idx = find_slot(allocTable, allocCapacity, ptr);
+  return allocTable[idx].ptr ? &allocTable[idx] : NULL;
+}
+
+static void untrack(AllocInfo *info) {
+  size_t mask = allocCapacity - 1;
+  size_t hole = (size_t)(info - allocTable);
+  size_t j = hole;
+  for (;;) {
+    j = (j + 1) & mask;
+    if (!allocTable[j].ptr) {
+      break;
+    }
+    size_t home = hash_ptr(allocTable[j].ptr) & mask;
+    // move the entry back if the hole lies between its home slot and j
+    if (((j - home) & mask) >= ((j - hole) & mask)) {
+      allocTable[hole] = allocTable[j];
+      hole = j;
+    }
+  }
+  allocTable[hole].ptr = NULL;
+  allocCount--;
+}
 
 void *debug_malloc(size_t size, const char *file, int line) {
   void *ptr = malloc(size);
@@ -19,20 +211,15 @@ void *debug_malloc(size_t size, const char *file, int line) {
     return NULL;
   }
 
-  AllocInfo *info = (AllocInfo *)malloc(sizeof(AllocInfo));
-  if (!info) {
+  pthread_mutex_lock(&trackerLock);
+  int tracked = track(ptr, size, file, line);
+  pthread_mutex_unlock(&trackerLock);
+  if (!tracked) {
     fprintf(stderr, "Failed to track allocation at %s:%d\n", file, line);
     free(ptr);
     return NULL;
   }
 
-  info->ptr = ptr;
-  info->size = size;
-  info->file = file;
-  info->line = line;
-  info->next = allocList;
-  allocList = info;
-
   return ptr;
 }
 
@@ -41,89 +228,164 @@ void *debug_realloc(void *ptr, size_t size, const char *file, int line) {
     return debug_malloc(size, file, line);
   }
 
-  AllocInfo *prev = NULL, *current = allocList;
-  while (current) {
-    if (current->ptr == ptr) {
-      void *new_ptr = realloc(ptr, size);
-      if (!new_ptr) {
-        fprintf(stderr, "Realloc failed at %s:%d\n", file, line);
-        return NULL;
-      }
+  pthread_mutex_lock(&trackerLock);
+  AllocInfo *info = lookup(ptr);
+  if (!info) {
+    pthread_mutex_unlock(&trackerLock);
+    fprintf(stderr, "Attempted to realloc unknown pointer at %s:%d\n", file,
+            line);
+    return NULL;
+  }
 
-      current->ptr = new_ptr;
-      current->size = size;
-      current->file = file;
-      current->line = line;
-      return new_ptr;
-    }
-    prev = current;
-    current = current->next;
+  void *new_ptr = realloc(ptr, size);
+  if (!new_ptr) {
+    pthread_mutex_unlock(&trackerLock);
+    fprintf(stderr, "Realloc failed at %s:%d\n", file, line);
+    return NULL;
   }
 
-  fprintf(stderr, "Attempted to realloc unknown pointer at %s:%d\n", file,
-          line);
-  return NULL;
+  // a realloc ends the old block's lifetime and starts a new one here
+  profile_free(info);
+  if (new_ptr == ptr) {
+    info->size = size;
+    info->file = file;
+    info->line = line;
+    profile_alloc(info);
+    pthread_mutex_unlock(&trackerLock);
+    return new_ptr;
+  }
+
+  // the old slot is removed first, so re-inserting never needs to grow
+  untrack(info);
+  track(new_ptr, size, file, line);
+  pthread_mutex_unlock(&trackerLock);
+  return new_ptr;
 }
 
 void debug_free(void *ptr, const char *file, int line) {
   if (!ptr)
     return;
 
-  AllocInfo *prev = NULL, *current = allocList;
-  while (current) {
-    if (current->ptr == ptr) {
-      if (prev) {
-        prev->next = current->next;
-      } else {
-        allocList = current->next;
-      }
-      free(current);
-      free(ptr);
-      return;
-    }
-    prev = current;
-    current = current->next;
+  pthread_mutex_lock(&trackerLock);
+  AllocInfo *info = lookup(ptr);
+  if (!info) {
+    pthread_mutex_unlock(&trackerLock);
+    fprintf(stderr, "Attempted to free unknown pointer at %s:%d\n", file,
+            line);
+    return;
   }
 
-  fprintf(stderr, "Attempted to free unknown pointer at %s:%d\n", file, line);
+  profile_free(info);
+  untrack(info);
+  pthread_mutex_unlock(&trackerLock);
+  free(ptr);
 }
 
 void *debug_calloc(size_t count, size_t size, const char *file, int line) {
   void *ptr = calloc(count, size);
   if (!ptr) {
     fprintf(stderr, "Calloc failed at %s:%d\n", file, line);
+    return NULL;
   }
 
-  AllocInfo *info = (AllocInfo *)malloc(sizeof(AllocInfo));
-  if (!info) {
+  pthread_mutex_lock(&trackerLock);
+  int tracked = track(ptr, count * size, file, line);
+  pthread_mutex_unlock(&trackerLock);
+  if (!tracked) {
     fprintf(stderr, "Failed to track allocation at %s:%d\n", file, line);
     free(ptr);
     return NULL;
   }
 
-  info->ptr = ptr;
-  info->size = count * size;
-  info->file = file;
-  info->line = line;
-  info->next = allocList;
-  allocList = info;
-
   return ptr;
 }
 
 void report_leaks(void) {
-  AllocInfo *current = allocList;
-  if (current) {
+  if (allocCount) {
     fprintf(stderr, "Memory leaks detected:\n");
-    while (current) {
-      fprintf(stderr, "Leaked %zu bytes at %s:%d (ptr: %p)\n", current->size,
-              current->file, current->line, current->ptr);
-      AllocInfo *next = current->next;
-      free(current);
-      current = next;
+    for (size_t i = 0; i < allocCapacity; i++) {
+      AllocInfo *info = &allocTable[i];
+      if (info->ptr) {
+        fprintf(stderr, "Leaked %zu bytes at %s:%d (ptr: %p)\n", info->size,
+                info->file, info->line, info->ptr);
+      }
     }
-    allocList = NULL;
   } else {
     printf("No memory leaks detected.\n");
   }
-}
\ No newline at end of file
+  free(allocTable);
+  allocTable = NULL;
+  allocCapacity = 0;
+  allocCount = 0;
+}
+
+unsigned long allocation_count(void) {
+  pthread_mutex_lock(&trackerLock);
+  unsigned long count = allocTick;
+  pthread_mutex_unlock(&trackerLock);
+  return count;
+}
+
+void profile_allocations(bool enable) { profiling = enable; }
+
+static int compare_sites(const void *a, const void *b) {
+  const AllocSite *left = a;
+  const AllocSite *right = b;
+  if (left->totalBytes != right->totalBytes) {
+    return left->totalBytes < right->totalBytes ? 1 : -1;
+  }
+  if (left->count != right->count) {
+    return left->count < right->count ? 1 : -1;
+  }
+  return 0;
+}
+
+static double average_lifetime(const AllocSite *site) {
+  return site->freed ? (double)site->totalLifetime / site->freed : 0.0;
+}
+
+void report_allocations(FILE *table, FILE *json) {
+  qsort(sites, siteCount, sizeof(AllocSite), compare_sites);
+  // site indices stored in live records are stale after sorting
+  for (size_t i = 0; i < allocCapacity; i++) {
+    allocTable[i].site = -1;
+  }
+
+  if (table) {
+    fprintf(table, "%-24s %10s %12s %12s %12s\n", "site", "allocs",
+            "bytes", "peak live", "avg life");
+    for (size_t i = 0; i < siteCount; i++) {
+      AllocSite *site = &sites[i];
+      char where[256];
+      snprintf(where, sizeof(where), "%s:%d", site->file, site->line);
+      fprintf(table, "%-24s %10lu %12zu %12zu %12.1f\n", where, site->count,
+              site->totalBytes, site->peakBytes, average_lifetime(site));
+    }
+  }
+
+  if (json) {
+    fprintf(json, "[");
+    for (size_t i = 0; i < siteCount; i++) {
+      AllocSite *site = &sites[i];
+      fprintf(json,
+              "%s\n  {\"file\": \"%s\", \"line\": %d, \"count\": %lu, "
+              "\"bytes\": %zu, \"peak\": %zu, \"live\": %zu, "
+              "\"avgLifetime\": %.2f, \"sizes\": [",
+              i ? "," : "", site->file, site->line, site->count,
+              site->totalBytes, site->peakBytes, site->liveBytes,
+              average_lifetime(site));
+      for (int b = 0; b < SIZE_BUCKETS; b++) {
+        fprintf(json, "%s%lu", b ? ", " : "", site->sizes[b]);
+      }
+      fprintf(json, "]}");
+    }
+    fprintf(json, "\n]\n");
+  }
+
+  free(sites);
+  free(siteIndex);
+  sites = NULL;
+  siteIndex = NULL;
+  siteCount = 0;
+  siteCapacity = 0;
+}
@@ -1,4 +1,6 @@
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 void *debug_malloc(size_t size, const char *file, int line);
 
 void *debug_realloc(void *ptr, size_t size, const char *file, int line);
@@ -9,6 +11,16 @@ void debug_free(void *ptr, const char *file, int line);
 
 void report_leaks(void);
 
+// Tracked allocations made so far, reallocs included.
+unsigned long allocation_count(void);
+
+// Aggregates allocations per call site while enabled.
+void profile_allocations(bool enable);
+
+// Prints per call site counts, bytes, peak live bytes and average lifetime
+// (in allocation ticks) sorted by total bytes. Either stream may be NULL.
+void report_allocations(FILE *table, FILE *json);
+
 #define malloc(size) debug_malloc(size, __FILE__, __LINE__)
 #define realloc(ptr, size) debug_realloc(ptr, size, __FILE__, __LINE__)
 #define calloc(ptr, size) debug_calloc(ptr, size, __FILE__, __LINE__)
@@ -0,0 +1,264 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "ast.h"
+#include "compiler.h"
+#include "fold.h"
+#include "intern.h"
+#include "memtracker.h"
+#include "module.h"
+#include "parser.h"
+#include "sb.h"
+#include "scope.h"
+#include "tokeniser.h"
+#include "trace.h"
+#include "type.h"
+
+bool is_module(TokenStream *tokens) {
+  return tokens->length >= 2 && tokens->kinds[0] == TT_NAME &&
+         tokens->kinds[1] == TT_OP && tokens->values[1].op == OP_ASSIGN;
+}
+
+static char *parse_definition(Definition *def, TokenStream *tokens,
+                              TokenSlice slice, bool shared, Arena *arena) {
+  if (slice.end - slice.begin < 3 || tokens->kinds[slice.begin] != TT_NAME ||
+      tokens->kinds[slice.begin + 1] != TT_OP ||
+      tokens->values[slice.begin + 1].op != OP_ASSIGN) {
+    return "Expected a definition of the form name = (args) => body";
+  }
+  *def = (Definition){.name = tokens->values[slice.begin].name,
+                      .tokens = slice};
+  TokenSlice value = {.begin = slice.begin + 2, .end = slice.end};
+  char *error = (shared ? parse_shared : parse)(&def->func, tokens, value,
+                                                arena);
+  if (error) {
+    return error;
+  }
+  if (def->func.type != EXPR_FUNC) {
+    return "Only functions can be defined at the top level";
+  }
+  ast_build(&def->ast, def->func, shared, arena);
+  return NULL;
+}
+
+void module_add(Module *module, Definition def, Arena *arena) {
+  if (module->count == module->capacity) {
+    int oldCapacity = module->capacity;
+    module->capacity = (module->capacity + 1) * 2;
+    module->defs = arena_realloc(arena, module->defs,
+                                 oldCapacity * sizeof(Definition),
+                                 module->capacity * sizeof(Definition));
+  }
+  module->defs[module->count++] = def;
+}
+
+char *parse_definitions(Module *module, TokenStream *tokens, TokenSlice slice,
+                        bool shared, Arena *arena) {
+  int begin = slice.begin;
+  for (int i = slice.begin; i <= slice.end; i++) {
+    if (i < slice.end && tokens->kinds[i] != TT_SEMICOLON) {
+      if (tokens->kinds[i] == TT_OPEN_PARENS ||
+          tokens->kinds[i] == TT_OPEN_BLOCK) {
+        i = tokens->values[i].group.match;
+      }
+      continue;
+    }
+    TokenSlice item = {.begin = begin, .end = i};
+    begin = i + 1;
+    if (item.begin == item.end) {
+      continue;
+    }
+
+    Definition def;
+    char *error = parse_definition(&def, tokens, item, shared, arena);
+    if (error) {
+      return error;
+    }
+    module_add(module, def, arena);
+  }
+  return NULL;
+}
+
+char *check_module(Module *module, Arena *arena) {
+  // names already defined; the types are unused
+  Scope defined = {0};
+  for (int i = 0; i < module->count; i++) {
+    if (scope_lookup(&defined, module->defs[i].name)) {
+      return "Duplicate definition";
+    }
+    scope_define(&defined, module->defs[i].name, (Type){.type = TYPE_NULL},
+                 arena);
+  }
+  return NULL;
+}
+
+char *parse_module(Module *module, TokenStream *tokens, bool shared,
+                   Arena *arena) {
+  Module result = {0};
+  char *error = parse_definitions(&result, tokens,
+                                  (TokenSlice){0, tokens->length}, shared,
+                                  arena);
+  if (error) {
+    return error;
+  }
+  error = check_module(&result, arena);
+  if (error) {
+    return error;
+  }
+  *module = result;
+  return NULL;
+}
+
+typedef struct {
+  StringBuilder impl;
+  char *error;
+} CompiledDefinition;
+
+typedef struct {
+  Module *module;
+  CompiledDefinition *out;
+  atomic_int next;
+} CompileJob;
+
+static void compile_definition(Definition *def, CompiledDefinition *out,
+                               Arena *arena) {
+  const char *name = atom_name(def->name);
+  NodeId func = ast_root(&def->ast);
+  trace_begin("type", name);
+  out->error = annotate_ast_types(&def->ast);
+  trace_end();
+  if (out->error) {
+    return;
+  }
+  if (def->ast.types[def->ast.lhs[func]] == TYPE_NULL) {
+    out->error = "Can't infer the return type";
+    return;
+  }
+  trace_begin("codegen", name);
+  out->error =
+      compile_function(&out->impl, &def->ast, func, (char *)name, arena);
+  trace_end();
+}
+
+static void *compile_worker(void *context) {
+  CompileJob *job = context;
+  Arena arena = {0};
+  for (;;) {
+    int i = atomic_fetch_add(&job->next, 1);
+    if (i >= job->module->count) {
+      break;
+    }
+    if (job->module->defs[i].impl) {
+      continue;
+    }
+    compile_definition(&job->module->defs[i], &job->out[i], &arena);
+  }
+  arena_free(&arena);
+  return NULL;
+}
+
+static const char *keep(StringBuilder *sb, Arena *arena) {
+  char *copy = arena_alloc(arena, sb->length + 1);
+  memcpy(copy, sb->data ? sb->data : "", sb->length + 1);
+  return copy;
+}
+
+char *compile_module(StringBuilder *decl, StringBuilder *impl, Module *module,
+                     int jobs, int *failed, Arena *arena) {
+  CompileJob job = {.module = module,
+                    .out = calloc(module->count + 1,
+                                  sizeof(CompiledDefinition))};
+  atomic_init(&job.next, 0);
+
+  if (jobs > module->count) {
+    jobs = module->count;
+  }
+  pthread_t *threads = calloc(jobs + 1, sizeof(pthread_t));
+  int started = 0;
+  for (int i = 1; i < jobs; i++) {
+    if (pthread_create(&threads[started], NULL, compile_worker, &job) != 0) {
+      break;
+    }
+    started++;
+  }
+  // the calling thread works too, so jobs == 1 never spawns a thread
+  compile_worker(&job);
+  for (int i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+
+  char *error = NULL;
+  for (int i = 0; i < module->count; i++) {
+    Definition *def = &module->defs[i];
+    CompiledDefinition *out = &job.out[i];
+    if (!error && out->error) {
+      error = out->error;
+      *failed = i;
+    }
+    if (!def->impl) {
+      // a function needs no declarations
+      def->decl = "";
+      def->impl = keep(&out->impl, arena);
+    }
+    if (!error) {
+      sb_write(decl, def->decl);
+      sb_write(impl, def->impl);
+    }
+    free(out->impl.data);
+  }
+  free(job.out);
+  return error;
+}
+
+char *compile_text(StringBuilder *decl, StringBuilder *impl, const char *text,
+                   size_t len, bool shared, int jobs, Arena *arena) {
+  TokenStream tokens = {0};
+  char *error = tokenize(&tokens, text, len, arena);
+  if (error) {
+    return error;
+  }
+
+  if (is_module(&tokens)) {
+    Module module;
+    error = parse_module(&module, &tokens, shared, arena);
+    if (error) {
+      return error;
+    }
+    for (int i = 0; i < module.count; i++) {
+      fold_constants(&module.defs[i].ast, arena);
+    }
+    int failed;
+    return compile_module(decl, impl, &module, jobs, &failed, arena);
+  }
+
+  int end = tokens.length;
+  if (end > 0 && tokens.kinds[end - 1] == TT_SEMICOLON) {
+    end--;
+  }
+  Expr expr = {.type = EXPR_NULL};
+  error = (shared ? parse_shared : parse)(&expr, &tokens, (TokenSlice){0, end},
+                                          arena);
+  if (error) {
+    return error;
+  }
+  Ast ast;
+  ast_build(&ast, expr, shared, arena);
+  fold_constants(&ast, arena);
+  NodeId func = ast_root(&ast);
+  if (ast.kinds[func] != NODE_FUNC) {
+    return "Only functions can be compiled";
+  }
+  error = annotate_ast_types(&ast);
+  if (error) {
+    return error;
+  }
+  if (ast.types[ast.lhs[func]] == TYPE_NULL) {
+    return "Can't infer the return type of main";
+  }
+  return compile_function(impl, &ast, func, "main", arena);
+}
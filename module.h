@@ -0,0 +1,59 @@
+#ifndef MODULE_H
+#define MODULE_H
+#include <stdbool.h>
+
+#include "arena.h"
+#include "ast.h"
+#include "intern.h"
+#include "parser.h"
+#include "sb.h"
+#include "tokeniser.h"
+
+// One top level `name = (args) => body` definition.
+typedef struct {
+  Atom name;
+  Expr func; // always EXPR_FUNC
+  Ast ast;   // func flattened, which the compile passes run on
+  TokenSlice tokens;
+  // generated code, set by compile_module. Definitions that already have
+  // it, for example from a cache, aren't compiled again
+  const char *decl;
+  const char *impl;
+} Definition;
+
+// Definitions in source order, separated by top level semicolons.
+typedef struct {
+  Definition *defs;
+  int count;
+  int capacity;
+} Module;
+
+// True when tokens start with a definition rather than a bare expression.
+bool is_module(TokenStream *tokens);
+
+char *parse_module(Module *module, TokenStream *tokens, bool shared,
+                   Arena *arena);
+
+void module_add(Module *module, Definition def, Arena *arena);
+
+// Appends the definitions in a slice of top level items to module.
+char *parse_definitions(Module *module, TokenStream *tokens, TokenSlice slice,
+                        bool shared, Arena *arena);
+
+// Rejects modules that define a name twice.
+char *check_module(Module *module, Arena *arena);
+
+// Type checks and compiles every definition on up to jobs threads, each
+// with its own arena and output buffers, then appends the results to decl
+// and impl in source order, keeping a copy of each in arena. On error
+// *failed is the index of the first definition that failed. The types are
+// kept in each definition's ast, which lives in the module's arena.
+char *compile_module(StringBuilder *decl, StringBuilder *impl, Module *module,
+                     int jobs, int *failed, Arena *arena);
+
+// Compiles a whole source text, either a module or a single function that
+// is named main, without printing anything.
+char *compile_text(StringBuilder *decl, StringBuilder *impl, const char *text,
+                   size_t len, bool shared, int jobs, Arena *arena);
+
+#endif
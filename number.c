@@ -0,0 +1,316 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "number.h"
+#include "scan.h"
+
+// Significant digits that always fit a uint64_t.
+#define MAX_DIGITS 19
+// Longest literal the slow path copies; longer ones are rejected.
+#define MAX_LITERAL 1024
+
+// The binary layout Eisel-Lemire rounds into.
+typedef struct {
+  int mantissaBits; // explicit bits
+  int minimumExponent;
+  int infinitePower;
+  int smallestPowerOfTen; // anything smaller rounds to zero
+  int largestPowerOfTen;  // anything larger rounds to infinity
+  int minRoundToEven;     // exact halfway cases only happen in this range
+  int maxRoundToEven;
+} FloatFormat;
+
+static const FloatFormat binary64 = {52, -1023, 0x7ff, -342, 308, -4, 23};
+static const FloatFormat binary32 = {23, -127, 0xff, -65, 38, -17, 10};
+
+// The decimal significand and exponent of a float literal.
+typedef struct {
+  uint64_t mantissa;
+  int64_t exponent;
+  int digits;     // significant digits read into mantissa
+  bool truncated; // nonzero digits past MAX_DIGITS were dropped
+} Decimal;
+
+static bool is_digit(char c) { return scan_class(c) & SCAN_DIGIT; }
+
+static uint64_t load8(const char *p) {
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap64(value);
+#endif
+  return value;
+}
+
+static bool is_eight_digits(uint64_t chunk) {
+  return (((chunk + 0x4646464646464646ULL) |
+           (chunk - 0x3030303030303030ULL)) &
+          0x8080808080808080ULL) == 0;
+}
+
+// Combines eight ASCII digits, first digit in the low byte, pairwise.
+static uint32_t parse_eight_digits(uint64_t chunk) {
+  chunk = (chunk & 0x0f0f0f0f0f0f0f0fULL) * 2561 >> 8;
+  chunk = (chunk & 0x00ff00ff00ff00ffULL) * 6553601 >> 16;
+  return (uint32_t)((chunk & 0x0000ffff0000ffffULL) * 42949672960001ULL >>
+                    32);
+}
+
+// Reads a run of digits into d. Fraction digits scale the exponent down;
+// integer digits dropped past MAX_DIGITS scale it up.
+static size_t read_digits(const char *buf, size_t i, size_t len, Decimal *d,
+                          bool fraction) {
+  for (;;) {
+    // leading zeros don't count, so eight at once only after the first
+    // significant digit
+    while (d->mantissa && d->digits + 8 <= MAX_DIGITS && i + 8 <= len &&
+           is_eight_digits(load8(buf + i))) {
+      d->mantissa = d->mantissa * 100000000 + parse_eight_digits(load8(buf + i));
+      d->digits += 8;
+      d->exponent -= fraction ? 8 : 0;
+      i += 8;
+    }
+    if (i >= len || !is_digit(buf[i])) {
+      return i;
+    }
+    int digit = buf[i++] - '0';
+    if (d->digits < MAX_DIGITS) {
+      d->mantissa = d->mantissa * 10 + digit;
+      d->digits += d->mantissa != 0;
+      d->exponent -= fraction;
+    } else {
+      d->truncated |= digit != 0;
+      d->exponent += !fraction;
+    }
+  }
+}
+
+typedef struct {
+  uint64_t high;
+  uint64_t low;
+} U128;
+
+static U128 multiply(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+  unsigned __int128 product = (unsigned __int128)a * b;
+  return (U128){(uint64_t)(product >> 64), (uint64_t)product};
+#else
+  uint64_t aLow = (uint32_t)a, aHigh = a >> 32;
+  uint64_t bLow = (uint32_t)b, bHigh = b >> 32;
+  uint64_t lowLow = aLow * bLow;
+  uint64_t highLow = aHigh * bLow + (lowLow >> 32);
+  uint64_t lowHigh = aLow * bHigh + (uint32_t)highLow;
+  return (U128){aHigh * bHigh + (highLow >> 32) + (lowHigh >> 32),
+                (lowHigh << 32) | (uint32_t)lowLow};
+#endif
+}
+
+static int leading_zeros(uint64_t x) {
+#if defined(__GNUC__)
+  return __builtin_clzll(x);
+#else
+  int n = 0;
+  while (!(x & 0x8000000000000000ULL)) {
+    x <<= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+// Eisel-Lemire: w * 10^q rounded to nearest even in format, as raw bits.
+// w must be the exact significand, nonzero.
+static uint64_t eisel_lemire(uint64_t w, int64_t q, const FloatFormat *f) {
+  if (w == 0 || q < f->smallestPowerOfTen) {
+    return 0;
+  }
+  if (q > f->largestPowerOfTen) {
+    return (uint64_t)f->infinitePower << f->mantissaBits;
+  }
+  int lz = leading_zeros(w);
+  w <<= lz;
+
+  // w * 5^q needs only mantissaBits + 3 correct high bits; the second half
+  // of the power is only read when the first leaves them ambiguous
+  const uint64_t *power = powersOfFive[q - POW5_MIN_EXPONENT];
+  uint64_t precisionMask = 0xffffffffffffffffULL >> (f->mantissaBits + 3);
+  U128 product = multiply(w, power[0]);
+  if ((product.high & precisionMask) == precisionMask) {
+    U128 second = multiply(w, power[1]);
+    product.low += second.high;
+    product.high += second.high > product.low;
+  }
+
+  int upperBit = (int)(product.high >> 63);
+  int shift = upperBit + 64 - f->mantissaBits - 3;
+  uint64_t mantissa = product.high >> shift;
+  // floor(log2(10^q)) + 63, exact over the table's range
+  int64_t power2 = ((((152170 + 65536) * q) >> 16) + 63) + upperBit - lz -
+                   f->minimumExponent;
+
+  if (power2 <= 0) {
+    // subnormal
+    if (-power2 + 1 >= 64) {
+      return 0;
+    }
+    mantissa >>= -power2 + 1;
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    power2 = mantissa < (1ULL << f->mantissaBits) ? 0 : 1;
+    return mantissa | (uint64_t)power2 << f->mantissaBits;
+  }
+
+  // an exact halfway case rounds to even rather than up
+  if (product.low <= 1 && q >= f->minRoundToEven && q <= f->maxRoundToEven &&
+      (mantissa & 3) == 1 && (mantissa << shift) == product.high) {
+    mantissa &= ~1ULL;
+  }
+  mantissa += mantissa & 1;
+  mantissa >>= 1;
+  if (mantissa >= (2ULL << f->mantissaBits)) {
+    mantissa = 1ULL << f->mantissaBits;
+    power2++;
+  }
+  mantissa &= ~(1ULL << f->mantissaBits);
+  if (power2 >= f->infinitePower) {
+    return (uint64_t)f->infinitePower << f->mantissaBits;
+  }
+  return mantissa | (uint64_t)power2 << f->mantissaBits;
+}
+
+static const double exactPowers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                     1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                     1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Rounds d into format, returning false when only the slow path can tell.
+static bool decimal_to_bits(Decimal *d, const FloatFormat *f, uint64_t *bits) {
+  bool single = f == &binary32;
+  if (!d->truncated) {
+    // Clinger: both operands are exact, so one rounding is correct
+    int64_t maxExponent = single ? 10 : 22;
+    uint64_t maxMantissa = 1ULL << (f->mantissaBits + 1);
+    if (d->exponent >= -maxExponent && d->exponent <= maxExponent &&
+        d->mantissa <= maxMantissa) {
+      if (single) {
+        float value = (float)d->mantissa;
+        float scale = (float)exactPowers[d->exponent < 0 ? -d->exponent
+                                                         : d->exponent];
+        value = d->exponent < 0 ? value / scale : value * scale;
+        uint32_t raw;
+        memcpy(&raw, &value, sizeof(raw));
+        *bits = raw;
+      } else {
+        double value = (double)d->mantissa;
+        double scale = exactPowers[d->exponent < 0 ? -d->exponent
+                                                   : d->exponent];
+        value = d->exponent < 0 ? value / scale : value * scale;
+        memcpy(bits, &value, sizeof(*bits));
+      }
+      return true;
+    }
+    *bits = eisel_lemire(d->mantissa, d->exponent, f);
+    return true;
+  }
+  // the dropped digits put the value between w and w + 1
+  *bits = eisel_lemire(d->mantissa, d->exponent, f);
+  return eisel_lemire(d->mantissa + 1, d->exponent, f) == *bits;
+}
+
+// Matches one of the type suffixes, not followed by more of a name.
+static bool has_suffix(const char *buf, size_t i, size_t len,
+                       const char *suffix) {
+  return i + 3 <= len && memcmp(buf + i, suffix, 3) == 0 &&
+         (i + 3 == len || !(scan_class(buf[i + 3]) & SCAN_NAME));
+}
+
+char *parse_number(const char *buf, size_t start, size_t len, Number *out,
+                   size_t *end) {
+  Decimal d = {0};
+  size_t i = read_digits(buf, start, len, &d, false);
+  bool decimal = false;
+  if (i < len && buf[i] == '.') {
+    decimal = true;
+    i = read_digits(buf, i + 1, len, &d, true);
+  }
+  // an exponent needs at least one digit; otherwise the 'e' starts a name
+  size_t sign = i + 1 < len && (buf[i + 1] == '+' || buf[i + 1] == '-');
+  if (i + 1 + sign < len && (buf[i] == 'e' || buf[i] == 'E') &&
+      is_digit(buf[i + 1 + sign])) {
+    decimal = true;
+    bool negative = sign && buf[i + 1] == '-';
+    int64_t exponent = 0;
+    for (i += 1 + sign; i < len && is_digit(buf[i]); i++) {
+      // past this every literal is zero or infinite anyway
+      if (exponent < 100000) {
+        exponent = exponent * 10 + (buf[i] - '0');
+      }
+    }
+    d.exponent += negative ? -exponent : exponent;
+  }
+  size_t textEnd = i;
+
+  NumberType type = decimal ? NUMBER_F32 : NUMBER_I32;
+  static const char *suffixes[] = {"i32", "i64", "f32", "f64"};
+  for (int s = 0; s < 4; s++) {
+    if (has_suffix(buf, i, len, suffixes[s])) {
+      type = (NumberType)s;
+      i += 3;
+      break;
+    }
+  }
+  *end = i;
+
+  if (type == NUMBER_I32 || type == NUMBER_I64) {
+    if (decimal) {
+      return "Integer suffix on a float literal";
+    }
+    uint64_t max = type == NUMBER_I32 ? INT32_MAX : INT64_MAX;
+    if (d.exponent > 0 || d.mantissa > max) {
+      return "Integer literal out of range";
+    }
+    *out = type == NUMBER_I32
+               ? (Number){.type = type, .value.i32 = (int32_t)d.mantissa}
+               : (Number){.type = type, .value.i64 = (int64_t)d.mantissa};
+    return NULL;
+  }
+
+  const FloatFormat *format = type == NUMBER_F32 ? &binary32 : &binary64;
+  uint64_t bits;
+  if (!decimal_to_bits(&d, format, &bits)) {
+    // too many digits to round from the first 19; let the C library do it
+    // on a copy
+    char text[MAX_LITERAL];
+    size_t textLen = textEnd - start;
+    if (textLen >= sizeof(text)) {
+      return "Numeric literal too long";
+    }
+    memcpy(text, buf + start, textLen);
+    text[textLen] = '\0';
+    if (type == NUMBER_F32) {
+      float value = strtof(text, NULL);
+      uint32_t raw;
+      memcpy(&raw, &value, sizeof(raw));
+      bits = raw;
+    } else {
+      double value = strtod(text, NULL);
+      memcpy(&bits, &value, sizeof(bits));
+    }
+  }
+
+  uint64_t exponentMask = (uint64_t)format->infinitePower
+                          << format->mantissaBits;
+  if ((bits & exponentMask) == exponentMask) {
+    return "Float literal out of range";
+  }
+  out->type = type;
+  if (type == NUMBER_F32) {
+    uint32_t raw = (uint32_t)bits;
+    memcpy(&out->value.f32, &raw, sizeof(raw));
+  } else {
+    memcpy(&out->value.f64, &bits, sizeof(bits));
+  }
+  return NULL;
+}
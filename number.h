@@ -0,0 +1,33 @@
+#ifndef NUMBER_H
+#define NUMBER_H
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum { NUMBER_I32, NUMBER_I64, NUMBER_F32, NUMBER_F64 } NumberType;
+
+typedef struct {
+  NumberType type;
+  union {
+    int32_t i32;
+    int64_t i64;
+    float f32;
+    double f64;
+  } value;
+} Number;
+
+// Reads the literal at buf[start] in place: digits with an optional
+// fraction and exponent, then an optional i32, i64, f32 or f64 suffix.
+// Unsuffixed literals are i32, or f32 with a '.' or exponent. Floats are
+// correctly rounded. Sets *end past the literal, or returns an error when
+// the value doesn't fit its type.
+char *parse_number(const char *buf, size_t start, size_t len, Number *out,
+                   size_t *end);
+
+// Range of the table below, in powers of ten.
+#define POW5_MIN_EXPONENT (-342)
+#define POW5_MAX_EXPONENT 308
+
+extern const uint64_t powersOfFive[POW5_MAX_EXPONENT - POW5_MIN_EXPONENT + 1]
+                                  [2];
+
+#endif
@@ -1,3 +1,6 @@
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "operator.h"
 
 int precidence(Operator op) {
@@ -15,4 +18,103 @@ int precidence(Operator op) {
   case OP_ARROW:
     return 0;
   }
-}
\ No newline at end of file
+}
+
+bool apply_int_op(Operator op, int left, int right, int *out) {
+  uint32_t a = (uint32_t)left;
+  uint32_t b = (uint32_t)right;
+  uint32_t result;
+  switch (op) {
+  case OP_ADD:
+    result = a + b;
+    break;
+  case OP_SUB:
+    result = a - b;
+    break;
+  case OP_MUL:
+    result = a * b;
+    break;
+  case OP_DIV:
+    // matches the emitted udiv
+    if (b == 0) {
+      return false;
+    }
+    result = a / b;
+    break;
+  default:
+    return false;
+  }
+  *out = (int)(int32_t)result;
+  return true;
+}
+
+bool apply_float_op(Operator op, float left, float right, float *out) {
+  float result;
+  switch (op) {
+  case OP_ADD:
+    result = left + right;
+    break;
+  case OP_SUB:
+    result = left - right;
+    break;
+  case OP_MUL:
+    result = left * right;
+    break;
+  case OP_DIV:
+    result = left / right;
+    break;
+  default:
+    return false;
+  }
+  *out = result;
+  return true;
+}
+
+bool apply_long_op(Operator op, int64_t left, int64_t right, int64_t *out) {
+  uint64_t a = (uint64_t)left;
+  uint64_t b = (uint64_t)right;
+  uint64_t result;
+  switch (op) {
+  case OP_ADD:
+    result = a + b;
+    break;
+  case OP_SUB:
+    result = a - b;
+    break;
+  case OP_MUL:
+    result = a * b;
+    break;
+  case OP_DIV:
+    if (b == 0) {
+      return false;
+    }
+    result = a / b;
+    break;
+  default:
+    return false;
+  }
+  *out = (int64_t)result;
+  return true;
+}
+
+bool apply_double_op(Operator op, double left, double right, double *out) {
+  double result;
+  switch (op) {
+  case OP_ADD:
+    result = left + right;
+    break;
+  case OP_SUB:
+    result = left - right;
+    break;
+  case OP_MUL:
+    result = left * right;
+    break;
+  case OP_DIV:
+    result = left / right;
+    break;
+  default:
+    return false;
+  }
+  *out = result;
+  return true;
+}
@@ -9,5 +9,19 @@ typedef enum {
   OP_ARROW,
 } Operator;
 
+#include <stdbool.h>
+#include <stdint.h>
+
 int precidence(Operator op);
+
+// Arithmetic with the semantics of the generated code: integers wrap
+// around and divide unsigned, f32 rounds to float. Returns false when the
+// operator doesn't apply or, for integers, on division by zero.
+bool apply_int_op(Operator op, int left, int right, int *out);
+
+bool apply_float_op(Operator op, float left, float right, float *out);
+
+bool apply_long_op(Operator op, int64_t left, int64_t right, int64_t *out);
+
+bool apply_double_op(Operator op, double left, double right, double *out);
 #endif
\ No newline at end of file
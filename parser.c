@@ -1,310 +1,446 @@
 #include <stdbool.h>
-#include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include "memtracker.h"
+#include "arena.h"
 #include "parser.h"
 #include "tokeniser.h"
 
-char *parse(Expr *expr, TokenVec outer_tokens, bool shouldFreeTokens) {
-  TokenVec tokens = outer_tokens;
-  if (tokens.length == 0) {
-    return "Can't parse empty tokenvec";
+// Splits the contents of the group opened at `open` into its separated
+// items. A trailing empty item is dropped and reported through `trailing`.
+static int group_items(TokenStream *tokens, int open, TokenSlice **items,
+                       bool *trailing, Arena *arena) {
+  int close = tokens->values[open].group.match;
+  *trailing = false;
+  if (close == open + 1) {
+    *items = NULL;
+    return 0;
   }
 
-  if (tokens.length == 1 && tokens.tokens[0].type == TT_PARENS) {
-    ParensToken callToken = *(ParensToken *)tokens.tokens[0].value.parens;
-    if (callToken.argc == 1) {
-      tokens = callToken.args[0];
-    }
+  int count = 0;
+  for (int sep = open; sep != close; sep = tokens->values[sep].group.next) {
+    count++;
   }
 
-  int lowest_p = 9999;
-  int lowest_p_idx = -1;
-
-  for (int i = 0; i < tokens.length; i++) {
-    Token token = tokens.tokens[i];
+  *items = arena_alloc(arena, sizeof(TokenSlice) * count);
+  int i = 0;
+  for (int sep = open; sep != close; sep = tokens->values[sep].group.next) {
+    (*items)[i++] =
+        (TokenSlice){.begin = sep + 1, .end = tokens->values[sep].group.next};
+  }
 
-    if (token.type == TT_OP) {
-      Operator op = token.value.op;
-      int p = precidence(op);
-      if (p < lowest_p) {
-        lowest_p = p;
-        lowest_p_idx = i;
-      }
-    }
+  if ((*items)[count - 1].begin == (*items)[count - 1].end) {
+    *trailing = true;
+    count--;
   }
+  return count;
+}
 
-  if (lowest_p_idx != -1) {
+// Hash-consing table of the operations and calls built so far in one
+// function body. Empty slots are EXPR_NULL.
+typedef struct {
+  Expr *nodes;
+  size_t count;
+  size_t capacity; // always a power of two
+} NodeTable;
+
+// Deepest the parser recurses, one level per nested bracket, function body
+// or right operand. Well within an 8 MB stack, the usual default.
+#define MAX_DEPTH 4096
+
+// Cursor over a read-only token slice; expressions are built left to right
+// by precedence climbing without copying any tokens.
+typedef struct {
+  TokenStream *tokens;
+  int pos;
+  int end;
+  Arena *arena;
+  NodeTable *shared; // NULL unless hash-consing
+  int depth;         // parse_expr calls in progress
+} Parser;
+
+static char *parse_expr(Parser *p, int minPrec, Expr *expr);
+
+// Parses a nested slice with the same options as p.
+static char *parse_slice(Parser *p, TokenSlice slice, Expr *expr) {
+  if (slice.begin == slice.end) {
+    return "Can't parse empty tokenvec";
+  }
 
-    TokenVec left = {0};
-    TokenVec right = {0};
+  Parser sub = *p;
+  sub.pos = slice.begin;
+  sub.end = slice.end;
+  char *error = parse_expr(&sub, 0, expr);
+  if (error) {
+    return error;
+  }
+  if (sub.pos != sub.end) {
+    return "Can't parse tokenvec";
+  }
+  return NULL;
+}
 
-    for (int i = 0; i < lowest_p_idx; i++) {
-      append_token(&left, copy_token(tokens.tokens[i]));
-    }
+// Children are already shared, so leaves compare by value and inner nodes
+// by pointer.
+static uint64_t expr_key(Expr expr) {
+  switch (expr.type) {
+  case EXPR_INT:
+    return (uint32_t)expr.value._int;
+  case EXPR_FLOAT: {
+    uint32_t bits;
+    memcpy(&bits, &expr.value._float, sizeof(bits));
+    return bits;
+  }
+  case EXPR_LONG:
+    return (uint64_t)expr.value._long;
+  case EXPR_DOUBLE: {
+    uint64_t bits;
+    memcpy(&bits, &expr.value._double, sizeof(bits));
+    return bits;
+  }
+  case EXPR_NAME:
+    return expr.value.name;
+  case EXPR_NULL:
+    return 0;
+  default:
+    return (uint64_t)(uintptr_t)expr.value.op;
+  }
+}
 
-    for (int i = lowest_p_idx + 1; i < tokens.length; i++) {
-      append_token(&right, copy_token(tokens.tokens[i]));
-    }
+static bool same_child(Expr a, Expr b) {
+  return a.type == b.type && expr_key(a) == expr_key(b);
+}
 
-    if ((tokens.tokens[lowest_p_idx].value.op) == OP_ARROW) {
-      *expr = (Expr){.type = EXPR_FUNC,
-                     .value.func = (void *)malloc(sizeof(FuncExpr))};
+static uint64_t mix(uint64_t hash, uint64_t value) {
+  return (hash ^ value) * 0x100000001b3ULL;
+}
 
-      Expr rightExpr = {.type = EXPR_NULL, .value = NULL};
+static uint64_t hash_node(Expr node) {
+  uint64_t hash = mix(0xcbf29ce484222325ULL, node.type);
+  if (node.type == EXPR_OP) {
+    Operation *op = node.value.op;
+    hash = mix(hash, op->op);
+    hash = mix(mix(hash, op->left.type), expr_key(op->left));
+    return mix(mix(hash, op->right.type), expr_key(op->right));
+  }
+  CallExpr *call = node.value.call;
+  hash = mix(mix(hash, call->func.type), expr_key(call->func));
+  for (int i = 0; i < call->argc; i++) {
+    hash = mix(mix(hash, call->args[i].type), expr_key(call->args[i]));
+  }
+  return hash;
+}
 
-      char *error = parse(&rightExpr, right, true);
-      if (error) {
-        return error;
-      }
+static bool same_node(Expr a, Expr b) {
+  if (a.type != b.type) {
+    return false;
+  }
+  if (a.type == EXPR_OP) {
+    return a.value.op->op == b.value.op->op &&
+           same_child(a.value.op->left, b.value.op->left) &&
+           same_child(a.value.op->right, b.value.op->right);
+  }
+  CallExpr *x = a.value.call;
+  CallExpr *y = b.value.call;
+  if (x->argc != y->argc || !same_child(x->func, y->func)) {
+    return false;
+  }
+  for (int i = 0; i < x->argc; i++) {
+    if (!same_child(x->args[i], y->args[i])) {
+      return false;
+    }
+  }
+  return true;
+}
 
-      int argc = 0;
-      if (left.length > 1) {
-        return "Can't parse function with more than one argument list";
-      }
-      if (left.tokens[0].type == TT_PARENS) {
-        TokenVec *argTokens =
-            ((ParensToken *)left.tokens[0].value.parens)->args;
-
-        argc = ((ParensToken *)left.tokens[0].value.parens)->argc;
-
-        *(FuncExpr *)(expr->value.func) = (FuncExpr){
-            .args = calloc(argc, sizeof(Arg)), .argc = argc, .body = rightExpr};
-
-        for (int i = 0; i < argc; i++) {
-          if (argTokens[i].length == 2) {
-            return "Can't parse function with non-name[: type] argument";
-          }
-          if (argTokens[i].length == 1) {
-            Token name = argTokens[i].tokens[0];
-            if (name.type == TT_NAME) {
-              FuncExpr *funcExpr = (FuncExpr *)expr->value.func;
-              char *nameStr = malloc(strlen(name.value.name) + 1);
-              strcpy(nameStr, name.value.name);
-              funcExpr->args[i] = (Arg){.name = nameStr, .type = NULL};
-            } else {
-              return "Can't use an expression as a function parameter name";
-            }
-          } else {
-            Token name = argTokens[i].tokens[0];
-            Token colon = argTokens[i].tokens[1];
-            TokenVec type = {0};
-            for (int j = 2; j < argTokens[i].length; j++) {
-              append_token(&type, copy_token(argTokens[i].tokens[j]));
-            }
-            if (name.type == TT_NAME && colon.type == TT_COLON) {
-              Expr typeExpr = {.type = EXPR_NULL, .value = NULL};
-              char *error = parse(&typeExpr, type, true);
-              if (error) {
-                return error;
-              }
-
-              if (typeExpr.type != EXPR_NAME) {
-                return "Types must be names";
-              }
-              char *typeName = typeExpr.value.name;
-
-              FuncExpr *funcExpr = (FuncExpr *)(expr->value.func);
-              char *nameStr = malloc(strlen(name.value.name) + 1);
-              strcpy(nameStr, name.value.name);
-              funcExpr->args[i] = (Arg){.name = nameStr, .type = typeName};
-            } else {
-              for (int j = 0; j < argTokens[i].length; j++) {
-                print_token(argTokens[i].tokens[j]);
-              }
-              return "Can't parse function with non-name: type argument";
-            }
-          }
+// Returns the earlier node structurally identical to node, or records node
+// as the first of its kind.
+static Expr share_node(Parser *p, Expr node) {
+  NodeTable *table = p->shared;
+  if (!table) {
+    return node;
+  }
+  if ((table->count + 1) * 2 > table->capacity) {
+    size_t capacity = table->capacity ? table->capacity * 2 : 64;
+    Expr *nodes = arena_calloc(p->arena, capacity, sizeof(Expr));
+    for (size_t i = 0; i < table->capacity; i++) {
+      if (table->nodes[i].type != EXPR_NULL) {
+        size_t slot = hash_node(table->nodes[i]) & (capacity - 1);
+        while (nodes[slot].type != EXPR_NULL) {
+          slot = (slot + 1) & (capacity - 1);
         }
-      } else {
-        return "Can't parse function with non-argument argument list";
+        nodes[slot] = table->nodes[i];
       }
+    }
+    table->nodes = nodes;
+    table->capacity = capacity;
+  }
 
-      for (int i = 0; i < left.length; i++) {
-        free_token(left.tokens[i]);
-      }
-      free(left.tokens);
-    } else {
+  size_t mask = table->capacity - 1;
+  size_t slot = hash_node(node) & mask;
+  while (table->nodes[slot].type != EXPR_NULL) {
+    if (same_node(table->nodes[slot], node)) {
+      return table->nodes[slot];
+    }
+    slot = (slot + 1) & mask;
+  }
+  table->nodes[slot] = node;
+  table->count++;
+  return node;
+}
 
-      *expr = (Expr){.type = EXPR_OP,
-                     .value.op = (void *)malloc(sizeof(Operation))};
+static bool right_assoc(Operator op) {
+  return op == OP_ASSIGN || op == OP_ARROW;
+}
 
-      Expr leftExpr = {.type = EXPR_NULL, .value = NULL};
-      Expr rightExpr = {.type = EXPR_NULL, .value = NULL};
+static char *parse_function(Parser *p, int open, Expr *expr) {
+  TokenStream *tokens = p->tokens;
+  unsigned char *kinds = tokens->kinds;
+  TokenValue *values = tokens->values;
+
+  *expr = (Expr){.type = EXPR_FUNC,
+                 .value.func = arena_alloc(p->arena, sizeof(FuncExpr))};
+
+  // the body extends over everything after the arrow. Names in it may mean
+  // something else than outside, so it shares nodes only with itself
+  p->pos = values[open].group.match + 2;
+  NodeTable *outer = p->shared;
+  NodeTable bodyNodes = {0};
+  if (outer) {
+    p->shared = &bodyNodes;
+  }
+  Expr rightExpr = {.type = EXPR_NULL};
+  char *error = parse_expr(p, precidence(OP_ARROW), &rightExpr);
+  p->shared = outer;
+  if (error) {
+    return error;
+  }
 
-      char *error = parse(&leftExpr, left, true);
-      if (error) {
-        return error;
-      }
+  TokenSlice *argTokens;
+  bool trailing;
+  int argc = group_items(tokens, open, &argTokens, &trailing, p->arena);
 
-      error = parse(&rightExpr, right, true);
-      if (error) {
-        return error;
-      }
+  *(FuncExpr *)(expr->value.func) = (FuncExpr){
+      .args = arena_calloc(p->arena, argc, sizeof(Arg)), .argc = argc, .body = rightExpr};
 
-      *(Operation *)(expr->value.op) =
-          (Operation){.left = leftExpr,
-                      .right = rightExpr,
-                      .op = tokens.tokens[lowest_p_idx].value.op};
+  for (int i = 0; i < argc; i++) {
+    TokenSlice arg = argTokens[i];
+    int argLength = arg.end - arg.begin;
+    if (argLength == 2) {
+      return "Can't parse function with non-name[: type] argument";
     }
-  } else if (tokens.length == 1 && tokens.tokens[0].type == TT_INT) {
-    *expr = (Expr){.type = EXPR_INT, .value._int = tokens.tokens[0].value._int};
-  } else if (tokens.length == 1 && tokens.tokens[0].type == TT_FLOAT) {
-    *expr = (Expr){.type = EXPR_FLOAT,
-                   .value._float = tokens.tokens[0].value._float};
-  } else if (tokens.length == 1 && tokens.tokens[0].type == TT_NAME) {
-    *expr = (Expr){.type = EXPR_NAME, .value.name = malloc(sizeof(char *))};
-    strcpy((char *)expr->value.name, tokens.tokens[0].value.name);
-  } else if (tokens.tokens[tokens.length - 1].type == TT_PARENS) {
-    ParensToken ct =
-        *(ParensToken *)tokens.tokens[tokens.length - 1].value.parens;
-    *expr = (Expr){.type = EXPR_CALL,
-                   .value.call = (void *)malloc(sizeof(CallExpr))};
-
-    Expr *args = malloc(sizeof(Expr) * ct.argc);
-    for (int i = 0; i < ct.argc; i++) {
-      Expr arg = {.type = EXPR_NULL, .value = NULL};
-      char *error = parse(&arg, ct.args[i], false);
+    if (argLength == 1) {
+      if (kinds[arg.begin] == TT_NAME) {
+        FuncExpr *funcExpr = (FuncExpr *)expr->value.func;
+        funcExpr->args[i] = (Arg){.name = values[arg.begin].name, .type = ATOM_NONE};
+      } else {
+        return "Can't use an expression as a function parameter name";
+      }
+    } else if (argLength > 2 && kinds[arg.begin] == TT_NAME &&
+               kinds[arg.begin + 1] == TT_COLON) {
+      TokenSlice type = {.begin = arg.begin + 2, .end = arg.end};
+      Expr typeExpr = {.type = EXPR_NULL};
+      char *error = parse(&typeExpr, tokens, type, p->arena);
       if (error) {
         return error;
       }
-      args[i] = arg;
-    }
 
-    Expr func = {.type = EXPR_NULL, .value = NULL};
-    // get all tokens to the left of the call
-    TokenVec left = {0};
-    for (int i = 0; i < tokens.length - 1; i++) {
-      append_token(&left, copy_token(tokens.tokens[i]));
-    }
-    char *error = parse(&func, left, true);
-    if (error) {
-      return error;
+      if (typeExpr.type != EXPR_NAME) {
+        return "Types must be names";
+      }
+      Atom typeName = typeExpr.value.name;
+
+      FuncExpr *funcExpr = (FuncExpr *)(expr->value.func);
+      funcExpr->args[i] =
+          (Arg){.name = values[arg.begin].name, .type = typeName};
+    } else {
+      return "Can't parse function with non-name: type argument";
     }
+  }
+  return NULL;
+}
 
-    *(CallExpr *)(expr->value.call) =
-        (CallExpr){.func = func, .args = args, .argc = ct.argc};
-  } else if (tokens.length == 1 && tokens.tokens[0].type == TT_BLOCK) {
-    BlockToken bt = *(BlockToken *)tokens.tokens[0].value.block;
+static char *parse_block(Parser *p, int open, Expr *expr) {
+  TokenSlice *stmtTokens;
+  bool trailing;
+  int stmtc = group_items(p->tokens, open, &stmtTokens, &trailing, p->arena);
 
-    *expr = (Expr){.type = EXPR_BLOCK,
-                   .value.block = (void *)malloc(sizeof(BlockExpr))};
+  *expr = (Expr){.type = EXPR_BLOCK,
+                 .value.block = arena_alloc(p->arena, sizeof(BlockExpr))};
 
-    Expr *stmts = malloc(sizeof(Expr) * bt.stmtc);
+  Expr *stmts = arena_alloc(p->arena, sizeof(Expr) * stmtc);
 
-    for (int i = 0; i < bt.stmtc; i++) {
-      Expr stmt = {.type = EXPR_NULL, .value = NULL};
-      char *error = parse(&stmt, bt.stmts[i], false);
-      if (error) {
-        return error;
-      }
-      stmts[i] = stmt;
+  for (int i = 0; i < stmtc; i++) {
+    Expr stmt = {.type = EXPR_NULL};
+    char *error = parse_slice(p, stmtTokens[i], &stmt);
+    if (error) {
+      return error;
     }
-
-    *(BlockExpr *)(expr->value.block) =
-        (BlockExpr){.stmts = stmts, .stmtc = bt.stmtc, .returns = bt.returns};
-  } else {
-    return "Can't parse tokenvec";
+    stmts[i] = stmt;
   }
 
-  if (shouldFreeTokens) {
-    for (int i = 0; i < outer_tokens.length; i++) {
-      free_token(outer_tokens.tokens[i]);
+  *(BlockExpr *)(expr->value.block) =
+      (BlockExpr){.stmts = stmts, .stmtc = stmtc, .returns = !trailing};
+  return NULL;
+}
+
+static char *parse_call(Parser *p, int open, Expr func, Expr *expr) {
+  TokenSlice *argTokens;
+  bool trailing;
+  int argc = group_items(p->tokens, open, &argTokens, &trailing, p->arena);
+  *expr = (Expr){.type = EXPR_CALL,
+                 .value.call = arena_alloc(p->arena, sizeof(CallExpr))};
+
+  Expr *args = arena_alloc(p->arena, sizeof(Expr) * argc);
+  for (int i = 0; i < argc; i++) {
+    Expr arg = {.type = EXPR_NULL};
+    char *error = parse_slice(p, argTokens[i], &arg);
+    if (error) {
+      return error;
     }
-    free(outer_tokens.tokens);
+    args[i] = arg;
   }
+
+  *(CallExpr *)(expr->value.call) =
+      (CallExpr){.func = func, .args = args, .argc = argc};
+  *expr = share_node(p, *expr);
   return NULL;
 }
 
-void free_expr(Expr expr) {
-  if (expr.type == EXPR_OP) {
-    Operation op = *(Operation *)expr.value.op;
-    free_expr(op.left);
-    free_expr(op.right);
-    free(expr.value.op);
-  }
-  if (expr.type == EXPR_CALL) {
-    CallExpr call = *(CallExpr *)expr.value.call;
-    for (int i = 0; i < call.argc; i++) {
-      free_expr(call.args[i]);
+// An operand: a literal, name, parenthesised expression, block or function,
+// followed by any number of call argument lists.
+static char *parse_primary(Parser *p, int minPrec, Expr *expr) {
+  unsigned char *kinds = p->tokens->kinds;
+  TokenValue *values = p->tokens->values;
+
+  if (p->pos == p->end || kinds[p->pos] == TT_OP) {
+    if (p->pos < p->end && values[p->pos].op == OP_ARROW) {
+      return "Can't parse function with non-argument argument list";
     }
-    free_expr(call.func);
-    free(call.args);
-    free(expr.value.call);
-  }
-  if (expr.type == EXPR_BLOCK) {
-    BlockExpr block = *(BlockExpr *)expr.value.block;
-    for (int i = 0; i < block.stmtc; i++) {
-      free_expr(block.stmts[i]);
+    return "Can't parse empty tokenvec";
+  }
+
+  int i = p->pos;
+  switch ((TokenKind)kinds[i]) {
+  case TT_INT:
+    *expr = (Expr){.type = EXPR_INT, .value._int = values[i]._int};
+    p->pos++;
+    break;
+  case TT_FLOAT:
+    *expr = (Expr){.type = EXPR_FLOAT, .value._float = values[i]._float};
+    p->pos++;
+    break;
+  case TT_LONG:
+    *expr = (Expr){.type = EXPR_LONG, .value._long = values[i]._long};
+    p->pos++;
+    break;
+  case TT_DOUBLE:
+    *expr = (Expr){.type = EXPR_DOUBLE, .value._double = values[i]._double};
+    p->pos++;
+    break;
+  case TT_NAME:
+    *expr = (Expr){.type = EXPR_NAME, .value.name = values[i].name};
+    p->pos++;
+    break;
+  case TT_OPEN_PARENS: {
+    int close = values[i].group.match;
+    if (minPrec <= precidence(OP_ARROW) && close + 1 < p->end &&
+        kinds[close + 1] == TT_OP && values[close + 1].op == OP_ARROW) {
+      return parse_function(p, i, expr);
+    }
+    TokenSlice *items;
+    bool trailing;
+    if (group_items(p->tokens, i, &items, &trailing, p->arena) != 1) {
+      // an argument list with nothing to call
+      return "Can't parse empty tokenvec";
+    }
+    char *error = parse_slice(p, items[0], expr);
+    if (error) {
+      return error;
     }
-    free(block.stmts);
-    free(expr.value.block);
+    p->pos = close + 1;
+    break;
   }
-  if (expr.type == EXPR_FUNC) {
-    FuncExpr func = *(FuncExpr *)expr.value.func;
-    for (int i = 0; i < func.argc; i++) {
-      free(func.args[i].type);
+  case TT_OPEN_BLOCK: {
+    char *error = parse_block(p, i, expr);
+    if (error) {
+      return error;
     }
-    free(func.args);
-    free_expr(func.body);
-    free(expr.value.func);
+    p->pos = values[i].group.match + 1;
+    break;
   }
-  if (expr.type == EXPR_NAME) {
-    free(expr.value.name);
+  default:
+    return "Can't parse tokenvec";
   }
-}
 
-#define parse(expr, tokens) parse(expr, tokens, true)
-
-void print_expr(Expr expr) {
-  if (expr.type == EXPR_INT) {
-    printf("%d", expr.value._int);
-  } else if (expr.type == EXPR_FLOAT) {
-    printf("%ff", expr.value._float);
-  } else if (expr.type == EXPR_OP) {
-    Operation op = *(Operation *)expr.value.op;
-    printf("(");
-    print_expr(op.left);
-    printf(" %c ", op.op);
-    print_expr(op.right);
-    printf(")");
-  } else if (expr.type == EXPR_NULL) {
-    printf("NULL");
-  } else if (expr.type == EXPR_NAME) {
-    printf("%s", (char *)expr.value.name);
-  } else if (expr.type == EXPR_CALL) {
-    CallExpr call = *(CallExpr *)expr.value.call;
-    print_expr(call.func);
-    printf("(");
-    for (int i = 0; i < call.argc; i++) {
-      print_expr(call.args[i]);
-      if (i < call.argc - 1) {
-        printf(", ");
-      }
+  while (p->pos < p->end && kinds[p->pos] == TT_OPEN_PARENS) {
+    int open = p->pos;
+    Expr func = *expr;
+    char *error = parse_call(p, open, func, expr);
+    if (error) {
+      return error;
     }
-    printf(")");
-  } else if (expr.type == EXPR_BLOCK) {
-    BlockExpr block = *(BlockExpr *)expr.value.block;
-    printf("{\n");
-    for (int i = 0; i < block.stmtc; i++) {
-      print_expr(block.stmts[i]);
-      printf(";\n");
+    p->pos = values[open].group.match + 1;
+  }
+  return NULL;
+}
+
+static char *parse_expr(Parser *p, int minPrec, Expr *expr) {
+  unsigned char *kinds = p->tokens->kinds;
+  TokenValue *values = p->tokens->values;
+  // an error ends the whole parse, so only success has to restore depth
+  if (p->depth == MAX_DEPTH) {
+    return "Expression is nested too deeply";
+  }
+  p->depth++;
+
+  int leftStart = p->pos;
+  Expr leftExpr = {.type = EXPR_NULL};
+  char *error = parse_primary(p, minPrec, &leftExpr);
+  if (error) {
+    return error;
+  }
+
+  while (p->pos < p->end && kinds[p->pos] == TT_OP) {
+    Operator op = values[p->pos].op;
+    int prec = precidence(op);
+    if (prec < minPrec) {
+      break;
     }
-    printf("}");
-  } else if (expr.type == EXPR_FUNC) {
-    FuncExpr func = *(FuncExpr *)expr.value.func;
-    printf("(");
-    for (int i = 0; i < func.argc; i++) {
-      printf("%s", func.args[i].name);
-      printf(":");
-      printf("%s", func.args[i].type);
-      if (i < func.argc - 1) {
-        printf(", ");
+    if (op == OP_ARROW) {
+      // a parameter list followed by => is handled in parse_primary
+      if (p->pos - leftStart == 1) {
+        return "Can't parse function with non-argument argument list";
       }
+      return "Can't parse function with more than one argument list";
     }
-    printf(") => ");
-    print_expr(func.body);
+    p->pos++;
+
+    Expr rightExpr = {.type = EXPR_NULL};
+    error = parse_expr(p, right_assoc(op) ? prec : prec + 1, &rightExpr);
+    if (error) {
+      return error;
+    }
+
+    Operation *operation = arena_alloc(p->arena, sizeof(Operation));
+    *operation = (Operation){.left = leftExpr, .right = rightExpr, .op = op};
+    leftExpr = share_node(p, (Expr){.type = EXPR_OP, .value.op = operation});
   }
-}
\ No newline at end of file
+
+  *expr = leftExpr;
+  p->depth--;
+  return NULL;
+}
+
+char *parse(Expr *expr, TokenStream *tokens, TokenSlice slice, Arena *arena) {
+  Parser p = {.tokens = tokens, .arena = arena};
+  return parse_slice(&p, slice, expr);
+}
+
+char *parse_shared(Expr *expr, TokenStream *tokens, TokenSlice slice,
+                   Arena *arena) {
+  NodeTable nodes = {0};
+  Parser p = {.tokens = tokens, .arena = arena, .shared = &nodes};
+  return parse_slice(&p, slice, expr);
+}
@@ -1,5 +1,7 @@
 #ifndef PARSER_H
 #define PARSER_H
+#include "arena.h"
+#include "intern.h"
 #include "operator.h"
 #include "tokeniser.h"
 #include <stdbool.h>
@@ -10,32 +12,38 @@ typedef struct FuncExpr FuncExpr;
 typedef struct Operation Operation;
 typedef struct CallExpr CallExpr;
 typedef struct BlockExpr BlockExpr;
+typedef struct Type Type;
 
 struct Expr {
   enum {
     EXPR_NULL,
-    EXPR_INT,   // value *int
-    EXPR_NAME,  // value *char
-    EXPR_FLOAT, // value *float
-    EXPR_OP,    // value *Operation
-    EXPR_CALL,  // value *CallExpr
-    EXPR_BLOCK, // value *BlockExpr
-    EXPR_FUNC   // value *FuncExpr
+    EXPR_INT,    // value *int
+    EXPR_NAME,   // value Atom
+    EXPR_FLOAT,  // value *float
+    EXPR_LONG,   // value int64_t
+    EXPR_DOUBLE, // value double
+    EXPR_OP,     // value *Operation
+    EXPR_CALL,   // value *CallExpr
+    EXPR_BLOCK,  // value *BlockExpr
+    EXPR_FUNC    // value *FuncExpr
   } type;
   union {
     int _int;
-    char *name;
+    Atom name;
     float _float;
+    int64_t _long;
+    double _double;
     Operation *op;
     CallExpr *call;
     BlockExpr *block;
     FuncExpr *func;
   } value;
+  const Type *resolved; // set by annotate_types, NULL until then
 };
 
 struct Arg {
-  char *name;
-  char *type;
+  Atom name;
+  Atom type; // ATOM_NONE when the argument is untyped
 };
 
 struct FuncExpr {
@@ -62,10 +70,13 @@ struct BlockExpr {
   bool returns;
 };
 
-char *parse(Expr *expr, TokenVec outer_tokens, bool shouldFreeTokens);
+// Rejects input nested more than a few thousand levels deep rather than
+// recursing far enough to overflow the stack.
+char *parse(Expr *expr, TokenStream *tokens, TokenSlice slice, Arena *arena);
 
-void free_expr(Expr expr);
-
-void print_expr(Expr expr);
+// Like parse, but structurally identical operations and calls within a
+// function body are built once and shared, making the result a DAG.
+char *parse_shared(Expr *expr, TokenStream *tokens, TokenSlice slice,
+                   Arena *arena);
 
 #endif
\ No newline at end of file
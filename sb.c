@@ -1,3 +1,4 @@
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,33 +9,81 @@
 #include <stddef.h>
 #include <string.h>
 
+#define SB_MIN_CAPACITY 64
+
+// Makes room for extra bytes plus the terminating NUL.
+static void sb_reserve(StringBuilder *sb, size_t extra) {
+  if (sb->drain && sb->length && sb->length + extra + 1 > sb->limit) {
+    sb->drain(sb, sb->drainContext);
+  }
+  size_t needed = sb->length + extra + 1;
+  if (needed <= sb->capacity) {
+    return;
+  }
+  size_t capacity = sb->capacity ? sb->capacity : SB_MIN_CAPACITY;
+  while (capacity < needed) {
+    capacity *= 2;
+  }
+  sb->data = realloc(sb->data, capacity);
+  sb->capacity = capacity;
+}
+
+void sb_append_n(StringBuilder *sb, const char *text, size_t len) {
+  sb_reserve(sb, len);
+  memcpy(sb->data + sb->length, text, len);
+  sb->length += len;
+  sb->data[sb->length] = '\0';
+}
+
 void sb_write(StringBuilder *sb, const char *text) {
-  if (sb->length >= sb->capacity) {
-    sb->capacity = 1 + sb->capacity * 2;
-    sb->strings = realloc(sb->strings, sizeof(char *) * sb->capacity);
+  sb_append_n(sb, text, strlen(text));
+}
+
+void sb_append_int(StringBuilder *sb, long long value) {
+  char digits[24];
+  size_t i = sizeof(digits);
+  unsigned long long magnitude =
+      value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+  do {
+    digits[--i] = (char)('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude);
+  if (value < 0) {
+    digits[--i] = '-';
   }
-  char *str = malloc(strlen(text) + 1);
-  strcpy(str, text);
-  sb->strings[sb->length++] = str;
+  sb_append_n(sb, digits + i, sizeof(digits) - i);
 }
 
-char *sb_to_string(StringBuilder *sb, bool free) {
-  size_t totalLength = 0;
-  for (size_t i = 0; i < sb->length; i++) {
-    totalLength += strlen(sb->strings[i]);
+void sb_printf(StringBuilder *sb, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  sb_reserve(sb, 0);
+  size_t available = sb->capacity - sb->length;
+  int len = vsnprintf(sb->data + sb->length, available, format, args);
+  va_end(args);
+  if (len < 0) {
+    return;
   }
-  char *out = malloc(sizeof(char) * totalLength + 1);
-  size_t idx = 0;
-  for (size_t i = 0; i < sb->length; i++) {
-    strcpy(out + idx, sb->strings[i]); // Properly copy strings
-    idx += strlen(sb->strings[i]);
+  if ((size_t)len >= available) {
+    sb_reserve(sb, (size_t)len);
+    va_start(args, format);
+    vsnprintf(sb->data + sb->length, (size_t)len + 1, format, args);
+    va_end(args);
   }
-  out[totalLength] = '\0';
+  sb->length += (size_t)len;
+}
+
+char *sb_to_string(StringBuilder *sb, bool free) {
+  sb_reserve(sb, 0);
+  sb->data[sb->length] = '\0';
   if (free) {
-    for (size_t i = 0; i < sb->length; i++) {
-      free(sb->strings[i]);
-    }
-    free(sb->strings);
+    char *out = sb->data;
+    sb->data = NULL;
+    sb->length = 0;
+    sb->capacity = 0;
+    return out;
   }
+  char *out = malloc(sb->length + 1);
+  memcpy(out, sb->data, sb->length + 1);
   return out;
-}
\ No newline at end of file
+}
@@ -2,14 +2,32 @@
 #define SB_H
 #include <stdbool.h>
 #include <stddef.h>
-typedef struct {
-  char **strings;
+
+typedef struct StringBuilder StringBuilder;
+
+// Growable byte buffer. data is always NUL terminated once anything has
+// been appended.
+struct StringBuilder {
+  char *data;
   size_t length;
   size_t capacity;
-} StringBuilder;
+  // Optional: called with the builder when an append would take it past
+  // limit. It must consume the contents and reset length to zero.
+  void (*drain)(StringBuilder *, void *);
+  void *drainContext;
+  size_t limit;
+};
 
 void sb_write(StringBuilder *, const char *);
 
+void sb_append_n(StringBuilder *, const char *, size_t);
+
+void sb_append_int(StringBuilder *, long long);
+
+void sb_printf(StringBuilder *, const char *format, ...);
+
+// With free set the buffer itself is handed to the caller and the builder
+// is reset; otherwise a copy is returned.
 char *sb_to_string(StringBuilder *, bool free);
 
-#endif
\ No newline at end of file
+#endif
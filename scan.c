@@ -0,0 +1,183 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "scan.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+#define S SCAN_SPACE
+#define D SCAN_DIGIT
+#define A SCAN_ALPHA
+
+const unsigned char scanClasses[256] = {
+    ['\t'] = S, ['\n'] = S, ['\v'] = S, ['\f'] = S, ['\r'] = S, [' '] = S,
+    ['0'] = D, ['1'] = D, ['2'] = D, ['3'] = D, ['4'] = D,
+    ['5'] = D, ['6'] = D, ['7'] = D, ['8'] = D, ['9'] = D,
+    ['_'] = A,
+    ['a'] = A, ['b'] = A, ['c'] = A, ['d'] = A, ['e'] = A, ['f'] = A,
+    ['g'] = A, ['h'] = A, ['i'] = A, ['j'] = A, ['k'] = A, ['l'] = A,
+    ['m'] = A, ['n'] = A, ['o'] = A, ['p'] = A, ['q'] = A, ['r'] = A,
+    ['s'] = A, ['t'] = A, ['u'] = A, ['v'] = A, ['w'] = A, ['x'] = A,
+    ['y'] = A, ['z'] = A,
+    ['A'] = A, ['B'] = A, ['C'] = A, ['D'] = A, ['E'] = A, ['F'] = A,
+    ['G'] = A, ['H'] = A, ['I'] = A, ['J'] = A, ['K'] = A, ['L'] = A,
+    ['M'] = A, ['N'] = A, ['O'] = A, ['P'] = A, ['Q'] = A, ['R'] = A,
+    ['S'] = A, ['T'] = A, ['U'] = A, ['V'] = A, ['W'] = A, ['X'] = A,
+    ['Y'] = A, ['Z'] = A,
+};
+
+#undef S
+#undef D
+#undef A
+
+static size_t scan_scalar(const char *buf, size_t start, size_t len,
+                          unsigned classes) {
+  size_t i = start;
+  while (i < len && (scan_class(buf[i]) & classes)) {
+    i++;
+  }
+  return i;
+}
+
+#ifdef SCAN_X86
+
+// Each vector unit builds a byte mask of the wanted classes with unsigned
+// range checks, (x - lo) <= (hi - lo), then the first byte outside them is
+// the lowest clear bit of its movemask.
+
+static inline __m128i in_range_sse2(__m128i x, char lo, char hi) {
+  __m128i shifted = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(hi - lo)),
+                        shifted);
+}
+
+static inline __m128i classify_sse2(__m128i x, unsigned classes) {
+  __m128i mask = _mm_setzero_si128();
+  if (classes & SCAN_SPACE) {
+    mask = _mm_or_si128(mask, _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')));
+    mask = _mm_or_si128(mask, in_range_sse2(x, '\t', '\r'));
+  }
+  if (classes & SCAN_DIGIT) {
+    mask = _mm_or_si128(mask, in_range_sse2(x, '0', '9'));
+  }
+  if (classes & SCAN_ALPHA) {
+    // setting 0x20 folds upper case into lower case
+    __m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+    mask = _mm_or_si128(mask, in_range_sse2(lower, 'a', 'z'));
+    mask = _mm_or_si128(mask, _mm_cmpeq_epi8(x, _mm_set1_epi8('_')));
+  }
+  return mask;
+}
+
+static size_t scan_sse2(const char *buf, size_t start, size_t len,
+                        unsigned classes) {
+  // most runs in real code are a byte or two; don't load a vector for them
+  if (start + 1 >= len || !(scan_class(buf[start + 1]) & classes)) {
+    return scan_scalar(buf, start, start + 1 < len ? start + 1 : len, classes);
+  }
+  size_t i = start;
+  while (i + 16 <= len) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(buf + i));
+    unsigned outside =
+        ~(unsigned)_mm_movemask_epi8(classify_sse2(block, classes)) & 0xffff;
+    if (outside) {
+      return i + __builtin_ctz(outside);
+    }
+    i += 16;
+  }
+  return scan_scalar(buf, i, len, classes);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+in_range_avx2(__m256i x, char lo, char hi) {
+  __m256i shifted = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(hi - lo)),
+                           shifted);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+classify_avx2(__m256i x, unsigned classes) {
+  __m256i mask = _mm256_setzero_si256();
+  if (classes & SCAN_SPACE) {
+    mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')));
+    mask = _mm256_or_si256(mask, in_range_avx2(x, '\t', '\r'));
+  }
+  if (classes & SCAN_DIGIT) {
+    mask = _mm256_or_si256(mask, in_range_avx2(x, '0', '9'));
+  }
+  if (classes & SCAN_ALPHA) {
+    __m256i lower = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+    mask = _mm256_or_si256(mask, in_range_avx2(lower, 'a', 'z'));
+    mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')));
+  }
+  return mask;
+}
+
+__attribute__((target("avx2"))) static size_t
+scan_avx2(const char *buf, size_t start, size_t len, unsigned classes) {
+  if (start + 1 >= len || !(scan_class(buf[start + 1]) & classes)) {
+    return scan_scalar(buf, start, start + 1 < len ? start + 1 : len, classes);
+  }
+  size_t i = start;
+  while (i + 32 <= len) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(buf + i));
+    unsigned outside =
+        ~(unsigned)_mm256_movemask_epi8(classify_avx2(block, classes));
+    if (outside) {
+      return i + __builtin_ctz(outside);
+    }
+    i += 32;
+  }
+  return scan_sse2(buf, i, len, classes);
+}
+
+#endif
+
+static const ScanRun scanRuns[SCAN_LEVELS] = {
+    scan_scalar,
+#ifdef SCAN_X86
+    scan_sse2,
+    scan_avx2,
+#endif
+};
+
+static const char *levelNames[SCAN_LEVELS] = {"scalar", "sse2", "avx2"};
+
+static pthread_once_t detectOnce = PTHREAD_ONCE_INIT;
+static ScanLevel best = SCAN_SCALAR;
+static ScanLevel level = SCAN_SCALAR;
+
+static void detect(void) {
+#ifdef SCAN_X86
+  __builtin_cpu_init();
+  best = __builtin_cpu_supports("avx2")   ? SCAN_AVX2
+         : __builtin_cpu_supports("sse2") ? SCAN_SSE2
+                                          : SCAN_SCALAR;
+#endif
+  level = best;
+}
+
+ScanRun scan_run(void) {
+  pthread_once(&detectOnce, detect);
+  return scanRuns[level];
+}
+
+ScanLevel scan_level(void) {
+  pthread_once(&detectOnce, detect);
+  return level;
+}
+
+const char *scan_level_name(ScanLevel level) { return levelNames[level]; }
+
+bool scan_set_level(ScanLevel wanted) {
+  pthread_once(&detectOnce, detect);
+  if (wanted > best) {
+    return false;
+  }
+  level = wanted;
+  return true;
+}
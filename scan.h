@@ -0,0 +1,37 @@
+#ifndef SCAN_H
+#define SCAN_H
+#include <stdbool.h>
+#include <stddef.h>
+
+// Byte classes of the lexer, combinable as masks.
+enum {
+  SCAN_SPACE = 1, // the C locale's isspace
+  SCAN_DIGIT = 2,
+  SCAN_ALPHA = 4, // letters and '_'
+  SCAN_NAME = SCAN_DIGIT | SCAN_ALPHA,
+};
+
+extern const unsigned char scanClasses[256];
+
+static inline unsigned scan_class(char c) {
+  return scanClasses[(unsigned char)c];
+}
+
+// Returns the end of the run of bytes in any of the classes starting at
+// start, or len. Picks the widest vector unit the CPU supports on first use.
+typedef size_t (*ScanRun)(const char *buf, size_t start, size_t len,
+                          unsigned classes);
+
+typedef enum { SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2, SCAN_LEVELS } ScanLevel;
+
+ScanRun scan_run(void);
+
+ScanLevel scan_level(void);
+
+const char *scan_level_name(ScanLevel level);
+
+// Forces a level, for comparing them. Returns false if the CPU lacks it.
+// Not thread safe: call it before tokenizing.
+bool scan_set_level(ScanLevel level);
+
+#endif
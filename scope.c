@@ -0,0 +1,55 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "arena.h"
+#include "scope.h"
+
+#define SCOPE_MIN_CAPACITY 8
+
+static size_t hash_atom(Atom atom) { return (size_t)atom * 2654435761u; }
+
+static Name *find_slot(Name *slots, size_t capacity, Atom name) {
+  size_t mask = capacity - 1;
+  size_t idx = hash_atom(name) & mask;
+  while (slots[idx].name != ATOM_NONE && slots[idx].name != name) {
+    idx = (idx + 1) & mask;
+  }
+  return &slots[idx];
+}
+
+void scope_define(Scope *scope, Atom name, Type type, Arena *arena) {
+  if ((scope->count + 1) * 2 > scope->capacity) {
+    size_t capacity =
+        scope->capacity ? scope->capacity * 2 : SCOPE_MIN_CAPACITY;
+    Name *slots = arena_calloc(arena, capacity, sizeof(Name));
+    for (size_t i = 0; i < scope->capacity; i++) {
+      if (scope->slots[i].name != ATOM_NONE) {
+        *find_slot(slots, capacity, scope->slots[i].name) = scope->slots[i];
+      }
+    }
+    scope->slots = slots;
+    scope->capacity = capacity;
+  }
+
+  Name *slot = find_slot(scope->slots, scope->capacity, name);
+  if (slot->name == ATOM_NONE) {
+    scope->count++;
+  }
+  *slot = (Name){.name = name, .type = type};
+}
+
+Name *scope_lookup(Scope *scope, Atom name) {
+  if (name == ATOM_NONE) {
+    return NULL;
+  }
+  for (; scope; scope = scope->parent) {
+    if (scope->capacity == 0) {
+      continue;
+    }
+    Name *slot = find_slot(scope->slots, scope->capacity, name);
+    if (slot->name == name) {
+      return slot;
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,24 @@
+#ifndef SCOPE_H
+#define SCOPE_H
+
+#include "arena.h"
+#include "intern.h"
+#include "type.h"
+
+typedef struct Scope Scope;
+
+// One lexical level of names, hashed by atom. Lookups that miss fall back
+// to the parent scope.
+struct Scope {
+  Scope *parent;
+  Name *slots;
+  size_t count;
+  size_t capacity;
+};
+
+void scope_define(Scope *scope, Atom name, Type type, Arena *arena);
+
+// Returns NULL when the name is not bound in this scope or any parent.
+Name *scope_lookup(Scope *scope, Atom name);
+
+#endif
@@ -0,0 +1,492 @@
+// accept4
+#define _GNU_SOURCE
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena.h"
+#include "cache.h"
+#include "eval.h"
+#include "intern.h"
+#include "memtracker.h"
+#include "module.h"
+#include "sb.h"
+#include "server.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#define MAX_FRAME (64 * 1024 * 1024)
+// A whole frame must be read or written within this long, however the
+// client paces it, so a slow client only holds a worker briefly.
+#define FRAME_TIMEOUT_MS 5000
+// Set explicitly rather than inherited from the process limits, so the
+// parser's nesting limit always fits.
+#define WORKER_STACK_SIZE (8 * 1024 * 1024)
+// Names are interned for good, so once this many have built up between
+// requests the intern table is emptied rather than left to fill.
+#define ATOM_RESET_COUNT (1 << 20)
+#define LATENCY_BUCKETS 32 // bucket i counts requests under 2^i microseconds
+
+typedef enum { CMD_COMPILE, CMD_EVAL, CMD_OTHER, CMD_COUNT } Command;
+
+static const char *commandNames[CMD_COUNT] = {"compile", "eval", "other"};
+
+typedef struct {
+  atomic_ulong count;
+  atomic_ulong errors;
+  atomic_ulong totalMicros;
+  atomic_ulong maxMicros;
+  atomic_ulong buckets[LATENCY_BUCKETS];
+} Latency;
+
+typedef struct {
+  int epoll;
+  int listener;
+  atomic_bool stopping;
+  Cache *cache;
+  pthread_mutex_t cacheLock; // Cache counters aren't atomic
+  // open[fd] is set while fd is a client connection, so the ones still
+  // open at shutdown can be closed
+  bool *open;
+  int openCapacity;
+  pthread_mutex_t openLock;
+  // held shared while a request runs and exclusively to reset the intern
+  // table, since no atom outlives its request
+  pthread_rwlock_t internLock;
+  Latency latency[CMD_COUNT];
+} Server;
+
+static void record_latency(Latency *latency, unsigned long micros,
+                           bool failed) {
+  atomic_fetch_add(&latency->count, 1);
+  atomic_fetch_add(&latency->errors, failed);
+  atomic_fetch_add(&latency->totalMicros, micros);
+  unsigned long max = atomic_load(&latency->maxMicros);
+  while (micros > max &&
+         !atomic_compare_exchange_weak(&latency->maxMicros, &max, micros)) {
+  }
+  int bucket = 0;
+  while (bucket < LATENCY_BUCKETS - 1 && micros >= (1ul << bucket)) {
+    bucket++;
+  }
+  atomic_fetch_add(&latency->buckets[bucket], 1);
+}
+
+// Upper bound of the bucket holding the given fraction of requests.
+static unsigned long latency_percentile(Latency *latency, double fraction) {
+  unsigned long count = atomic_load(&latency->count);
+  unsigned long seen = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += atomic_load(&latency->buckets[i]);
+    if (seen && seen >= fraction * count) {
+      return 1ul << i;
+    }
+  }
+  return 0;
+}
+
+static void write_stats(Server *server, StringBuilder *out) {
+  for (int i = 0; i < CMD_COUNT; i++) {
+    Latency *latency = &server->latency[i];
+    unsigned long count = atomic_load(&latency->count);
+    sb_printf(out,
+              "%s: %lu requests, %lu errors, mean %.1f us, p50 < %lu us, "
+              "p99 < %lu us, max %lu us\n",
+              commandNames[i], count, atomic_load(&latency->errors),
+              count ? (double)atomic_load(&latency->totalMicros) / count : 0.0,
+              latency_percentile(latency, 0.5),
+              latency_percentile(latency, 0.99),
+              atomic_load(&latency->maxMicros));
+  }
+  if (server->cache) {
+    pthread_mutex_lock(&server->cacheLock);
+    sb_printf(out, "cache: %lu hits, %lu misses\n", server->cache->hits,
+              server->cache->misses);
+    pthread_mutex_unlock(&server->cacheLock);
+  }
+}
+
+static char *compile_request(Server *server, const char *options,
+                             const char *text, size_t len, StringBuilder *out,
+                             Arena *arena) {
+  bool shared = strstr(options, "hash-cons") != NULL;
+  CacheKey key;
+  if (server->cache) {
+    key = cache_key(CACHE_FILE, shared ? "hash-cons" : "", text, len);
+    Source cached;
+    pthread_mutex_lock(&server->cacheLock);
+    bool hit = cache_get(server->cache, key, &cached);
+    pthread_mutex_unlock(&server->cacheLock);
+    if (hit) {
+      sb_append_n(out, cached.data, cached.len);
+      source_close(&cached);
+      return NULL;
+    }
+  }
+
+  StringBuilder decl = {0};
+  size_t start = out->length;
+  char *error = compile_text(&decl, out, text, len, shared, 1, arena);
+  if (!error && decl.length) {
+    sb_append_n(out, decl.data, decl.length);
+  }
+  free(decl.data);
+  if (!error && server->cache) {
+    pthread_mutex_lock(&server->cacheLock);
+    cache_put(server->cache, key, out->data + start, out->length - start);
+    pthread_mutex_unlock(&server->cacheLock);
+  }
+  return error;
+}
+
+static char *eval_request(const char *options, const char *text, size_t len,
+                          StringBuilder *out, Arena *arena) {
+  // options are the arguments: i32 unless they contain a '.'
+  Value args[64];
+  int argc = 0;
+  const char *p = options;
+  while (*p) {
+    while (*p == ' ') {
+      p++;
+    }
+    if (!*p) {
+      break;
+    }
+    if (argc == sizeof(args) / sizeof(args[0])) {
+      return "Too many arguments";
+    }
+    size_t wordLen = strcspn(p, " ");
+    if (!parse_value(p, wordLen, &args[argc++])) {
+      return "Invalid argument";
+    }
+    p += wordLen;
+  }
+
+  Value result;
+  char *error = eval_source(text, len, args, argc, &result, arena);
+  if (!error) {
+    format_value(out, result);
+  }
+  return error;
+}
+
+// Runs one request and fills response. Returns the command it ran.
+static Command handle_request(Server *server, StringBuilder *request,
+                              StringBuilder *response, Arena *arena,
+                              bool *failed) {
+  char *newline = memchr(request->data, '\n', request->length);
+  size_t lineLen = newline ? (size_t)(newline - request->data) : request->length;
+  // the command line is NUL terminated in place; the source follows it
+  request->data[lineLen] = '\0';
+  const char *text = request->data + lineLen + (newline ? 1 : 0);
+  size_t len = request->length - (size_t)(text - request->data);
+  const char *line = request->data;
+  size_t wordLen = strcspn(line, " ");
+  const char *options = line + wordLen + (line[wordLen] == ' ');
+
+  sb_write(response, "ok\n");
+  char *error = NULL;
+  Command command = CMD_OTHER;
+  if (wordLen == 7 && strncmp(line, "compile", 7) == 0) {
+    command = CMD_COMPILE;
+    error = compile_request(server, options, text, len, response, arena);
+  } else if (wordLen == 4 && strncmp(line, "eval", 4) == 0) {
+    command = CMD_EVAL;
+    error = eval_request(options, text, len, response, arena);
+  } else if (wordLen == 5 && strncmp(line, "stats", 5) == 0) {
+    write_stats(server, response);
+  } else if (wordLen == 8 && strncmp(line, "shutdown", 8) == 0) {
+    atomic_store(&server->stopping, true);
+  } else {
+    error = "Unknown command";
+  }
+
+  *failed = error != NULL;
+  if (error) {
+    response->length = 0;
+    sb_printf(response, "error\n%s", error);
+  }
+  return command;
+}
+
+#ifdef __linux__
+
+static struct timespec frame_deadline(void) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += FRAME_TIMEOUT_MS / 1000;
+  deadline.tv_nsec += FRAME_TIMEOUT_MS % 1000 * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+  return deadline;
+}
+
+// Waits until fd is ready for events, or returns false once the deadline
+// has passed.
+static bool wait_ready(int fd, short events, struct timespec deadline) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  long ms = (deadline.tv_sec - now.tv_sec) * 1000 +
+            (deadline.tv_nsec - now.tv_nsec) / 1000000;
+  struct pollfd ready = {.fd = fd, .events = events};
+  return ms > 0 && poll(&ready, 1, (int)ms) == 1;
+}
+
+static bool read_full(int fd, void *buf, size_t len,
+                      struct timespec deadline) {
+  char *p = buf;
+  while (len) {
+    if (!wait_ready(fd, POLLIN, deadline)) {
+      return false;
+    }
+    ssize_t n = read(fd, p, len);
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+static bool write_full(int fd, const void *buf, size_t len,
+                       struct timespec deadline) {
+  const char *p = buf;
+  while (len) {
+    if (!wait_ready(fd, POLLOUT, deadline)) {
+      return false;
+    }
+    // without MSG_DONTWAIT a blocking send waits for all of len
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+static bool read_frame(int fd, StringBuilder *frame) {
+  struct timespec deadline = frame_deadline();
+  unsigned char header[4];
+  if (!read_full(fd, header, sizeof(header), deadline)) {
+    return false;
+  }
+  size_t len = (size_t)header[0] << 24 | (size_t)header[1] << 16 |
+               (size_t)header[2] << 8 | header[3];
+  if (len > MAX_FRAME) {
+    return false;
+  }
+  if (frame->capacity < len + 1) {
+    frame->data = realloc(frame->data, len + 1);
+    frame->capacity = len + 1;
+  }
+  frame->length = len;
+  frame->data[len] = '\0';
+  return read_full(fd, frame->data, len, deadline);
+}
+
+static bool write_frame(int fd, StringBuilder *frame) {
+  struct timespec deadline = frame_deadline();
+  unsigned char header[4] = {
+      (unsigned char)(frame->length >> 24), (unsigned char)(frame->length >> 16),
+      (unsigned char)(frame->length >> 8), (unsigned char)frame->length};
+  return write_full(fd, header, sizeof(header), deadline) &&
+         write_full(fd, frame->data, frame->length, deadline);
+}
+
+static unsigned long elapsed_micros(struct timespec from) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long)((now.tv_sec - from.tv_sec) * 1000000 +
+                         (now.tv_nsec - from.tv_nsec) / 1000);
+}
+
+static void add_connection(Server *server, int fd) {
+  pthread_mutex_lock(&server->openLock);
+  if (fd >= server->openCapacity) {
+    int capacity = fd * 2 + 16;
+    server->open = realloc(server->open, capacity * sizeof(bool));
+    memset(server->open + server->openCapacity, 0,
+           (capacity - server->openCapacity) * sizeof(bool));
+    server->openCapacity = capacity;
+  }
+  server->open[fd] = true;
+  pthread_mutex_unlock(&server->openLock);
+}
+
+static void close_connection(Server *server, int fd) {
+  pthread_mutex_lock(&server->openLock);
+  server->open[fd] = false;
+  pthread_mutex_unlock(&server->openLock);
+  // closing removes fd from the epoll set too
+  close(fd);
+}
+
+static void rearm(Server *server, int fd) {
+  struct epoll_event event = {.events = EPOLLIN | EPOLLONESHOT,
+                              .data.fd = fd};
+  epoll_ctl(server->epoll, EPOLL_CTL_MOD, fd, &event);
+}
+
+// Each worker waits on the shared epoll set. One shot events hand every
+// ready connection to exactly one worker, which serves one request and
+// re-arms it, so a fixed pool serves any number of clients.
+static void *serve_worker(void *context) {
+  Server *server = context;
+  // kept across requests so steady state compiles don't touch malloc
+  Arena arena = {0};
+  StringBuilder request = {0};
+  StringBuilder response = {0};
+
+  while (!atomic_load(&server->stopping)) {
+    struct epoll_event event;
+    // wake up now and then to notice a shutdown
+    if (epoll_wait(server->epoll, &event, 1, 100) != 1) {
+      continue;
+    }
+    int fd = event.data.fd;
+    if (fd == server->listener) {
+      int client = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+      rearm(server, fd);
+      if (client >= 0) {
+        add_connection(server, client);
+        struct epoll_event clientEvent = {.events = EPOLLIN | EPOLLONESHOT,
+                                          .data.fd = client};
+        epoll_ctl(server->epoll, EPOLL_CTL_ADD, client, &clientEvent);
+      }
+      continue;
+    }
+
+    if (!read_frame(fd, &request)) {
+      close_connection(server, fd);
+      continue;
+    }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    arena_reset(&arena);
+    response.length = 0;
+    bool failed;
+    pthread_rwlock_rdlock(&server->internLock);
+    Command command =
+        handle_request(server, &request, &response, &arena, &failed);
+    pthread_rwlock_unlock(&server->internLock);
+    bool sent = write_frame(fd, &response);
+    record_latency(&server->latency[command], elapsed_micros(start), failed);
+    if (sent) {
+      rearm(server, fd);
+    } else {
+      close_connection(server, fd);
+    }
+    if (atom_count() > ATOM_RESET_COUNT) {
+      pthread_rwlock_wrlock(&server->internLock);
+      // another worker may have reset it while this one waited
+      if (atom_count() > ATOM_RESET_COUNT) {
+        intern_free();
+      }
+      pthread_rwlock_unlock(&server->internLock);
+    }
+  }
+
+  arena_free(&arena);
+  free(request.data);
+  free(response.data);
+  return NULL;
+}
+
+char *serve(const char *path, int workers, Cache *cache) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    return "Socket path too long";
+  }
+  strcpy(addr.sun_path, path);
+
+  int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listener < 0) {
+    return "Failed to create socket";
+  }
+  unlink(path);
+  if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(listener, 128) != 0) {
+    close(listener);
+    return "Failed to listen on socket";
+  }
+
+  Server *server = calloc(1, sizeof(Server));
+  server->listener = listener;
+  server->cache = cache;
+  server->epoll = epoll_create1(EPOLL_CLOEXEC);
+  pthread_mutex_init(&server->cacheLock, NULL);
+  pthread_mutex_init(&server->openLock, NULL);
+  pthread_rwlockattr_t lockAttr;
+  pthread_rwlockattr_init(&lockAttr);
+  // so a reset isn't put off for as long as requests keep arriving
+  pthread_rwlockattr_setkind_np(&lockAttr,
+                                PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+  pthread_rwlock_init(&server->internLock, &lockAttr);
+  pthread_rwlockattr_destroy(&lockAttr);
+  struct epoll_event event = {.events = EPOLLIN | EPOLLONESHOT,
+                              .data.fd = listener};
+  epoll_ctl(server->epoll, EPOLL_CTL_ADD, listener, &event);
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, WORKER_STACK_SIZE);
+  pthread_t *threads = calloc(workers, sizeof(pthread_t));
+  int started = 0;
+  for (int i = 0; i < workers; i++) {
+    if (pthread_create(&threads[started], &attr, serve_worker, server) == 0) {
+      started++;
+    }
+  }
+  pthread_attr_destroy(&attr);
+  for (int i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  for (int fd = 0; fd < server->openCapacity; fd++) {
+    if (server->open[fd]) {
+      close(fd);
+    }
+  }
+
+  char *error = started ? NULL : "Failed to start workers";
+  close(server->epoll);
+  close(listener);
+  unlink(path);
+  pthread_mutex_destroy(&server->cacheLock);
+  pthread_mutex_destroy(&server->openLock);
+  pthread_rwlock_destroy(&server->internLock);
+  free(server->open);
+  free(server);
+  return error;
+}
+
+#else
+
+char *serve(const char *path, int workers, Cache *cache) {
+  (void)path, (void)workers, (void)cache;
+  (void)handle_request;
+  return "The compile server needs epoll, which is only available on Linux";
+}
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "cache.h"
+
+// Serves requests on a Unix domain socket at path with a fixed pool of
+// worker threads, until a client asks it to shut down.
+//
+// Every message in either direction is a frame: a 4 byte big endian
+// length followed by that many bytes. A request is a command line, a
+// newline and the source text:
+//   compile [hash-cons]  returns the LLVM IR of a module or function
+//   eval [args...]       returns the value, calling a function with args
+//   stats                returns request counts and latencies
+//   shutdown             stops the server once in flight requests finish,
+//                        closing any connections still open
+// A response starts with "ok\n" or "error\n", followed by the result or
+// the error message. A connection is closed when one frame takes more than
+// five seconds to arrive or to be taken. cache may be NULL.
+char *serve(const char *path, int workers, Cache *cache);
+
+#endif
@@ -0,0 +1,151 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memtracker.h"
+#include "sb.h"
+#include "sink.h"
+
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#define SINK_MAX_IOVECS 2
+
+typedef struct {
+  const char *base;
+  size_t len;
+} Fragment;
+
+// Writes every fragment in order with as few system calls as possible,
+// resuming after short writes.
+static bool write_fragments(int fd, Fragment *fragments, int count) {
+#ifdef _WIN32
+  for (int i = 0; i < count; i++) {
+    const char *base = fragments[i].base;
+    size_t len = fragments[i].len;
+    while (len) {
+      int n = _write(fd, base, (unsigned int)len);
+      if (n <= 0) {
+        return false;
+      }
+      base += n;
+      len -= (size_t)n;
+    }
+  }
+  return true;
+#else
+  struct iovec iov[SINK_MAX_IOVECS];
+  int iovc = 0;
+  for (int i = 0; i < count && iovc < SINK_MAX_IOVECS; i++) {
+    if (fragments[i].len) {
+      iov[iovc++] =
+          (struct iovec){.iov_base = (void *)fragments[i].base,
+                         .iov_len = fragments[i].len};
+    }
+  }
+  struct iovec *next = iov;
+  while (iovc) {
+    ssize_t n = writev(fd, next, iovc);
+    if (n < 0) {
+      return false;
+    }
+    while (iovc && (size_t)n >= next->iov_len) {
+      n -= (ssize_t)next->iov_len;
+      next++;
+      iovc--;
+    }
+    if (iovc) {
+      next->iov_base = (char *)next->iov_base + n;
+      next->iov_len -= (size_t)n;
+    }
+  }
+  return true;
+#endif
+}
+
+static void drain_body(StringBuilder *body, void *context) {
+  OutputSink *sink = context;
+  Fragment fragment = {.base = body->data, .len = body->length};
+  if (!sink->failed && !write_fragments(sink->fd, &fragment, 1)) {
+    sink->failed = true;
+  }
+  sink->written += body->length;
+  body->length = 0;
+}
+
+char *sink_open(OutputSink *sink, const char *path) {
+  size_t len = strlen(path);
+  char *tempPath = malloc(len + sizeof(".tmp"));
+  memcpy(tempPath, path, len);
+  memcpy(tempPath + len, ".tmp", sizeof(".tmp"));
+#ifdef _WIN32
+  int fd = _open(tempPath, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+  int fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+  if (fd < 0) {
+    free(tempPath);
+    return "Failed to open output file";
+  }
+  char *pathCopy = malloc(len + 1);
+  memcpy(pathCopy, path, len + 1);
+  *sink = (OutputSink){.fd = fd, .path = pathCopy, .tempPath = tempPath};
+  sink->body.drain = drain_body;
+  sink->body.drainContext = sink;
+  sink->body.limit = SINK_CHUNK_SIZE;
+  return NULL;
+}
+
+char *sink_close(OutputSink *sink) {
+  Fragment fragments[SINK_MAX_IOVECS] = {
+      {.base = sink->body.data, .len = sink->body.length},
+      {.base = sink->decl.data, .len = sink->decl.length},
+  };
+  if (!sink->failed &&
+      !write_fragments(sink->fd, fragments, SINK_MAX_IOVECS)) {
+    sink->failed = true;
+  }
+  sink->written += sink->body.length + sink->decl.length;
+
+  free(sink->body.data);
+  free(sink->decl.data);
+#ifdef _WIN32
+  int closed = _close(sink->fd);
+  // rename doesn't replace an existing file there
+  if (!sink->failed && closed == 0) {
+    remove(sink->path);
+  }
+#else
+  int closed = close(sink->fd);
+#endif
+  bool failed = sink->failed || closed != 0 ||
+                rename(sink->tempPath, sink->path) != 0;
+  if (failed) {
+    remove(sink->tempPath);
+  }
+  free(sink->path);
+  free(sink->tempPath);
+  *sink = (OutputSink){.fd = -1, .written = sink->written};
+  return failed ? "Failed to write output file" : NULL;
+}
+
+void sink_discard(OutputSink *sink) {
+  free(sink->body.data);
+  free(sink->decl.data);
+#ifdef _WIN32
+  _close(sink->fd);
+#else
+  close(sink->fd);
+#endif
+  remove(sink->tempPath);
+  free(sink->path);
+  free(sink->tempPath);
+  *sink = (OutputSink){.fd = -1, .written = sink->written};
+}
@@ -0,0 +1,36 @@
+#ifndef SINK_H
+#define SINK_H
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "sb.h"
+
+#define SINK_CHUNK_SIZE (64 * 1024)
+
+// Output file fed by two builders. body is written out every time it
+// fills a chunk, so it stays bounded regardless of module size; decl is
+// kept in memory and appended after the body on close, which LLVM IR
+// allows since top-level entities may appear in any order. Everything goes
+// to a temporary file next to the output, which only replaces it once it
+// is complete, so a failed build leaves the previous output in place.
+typedef struct {
+  int fd;
+  char *path;
+  char *tempPath;
+  StringBuilder body;
+  StringBuilder decl;
+  size_t written;
+  bool failed;
+} OutputSink;
+
+char *sink_open(OutputSink *sink, const char *path);
+
+// Writes out whatever is still pending, closes the file and moves it over
+// the output.
+char *sink_close(OutputSink *sink);
+
+// Closes the file without writing what is pending and removes it, leaving
+// the output as it was.
+void sink_discard(OutputSink *sink);
+
+#endif
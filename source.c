@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "memtracker.h"
+#include "source.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static char *source_read(Source *source, const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    return "Failed to open file";
+  }
+  size_t capacity = 4096;
+  size_t len = 0;
+  char *buf = malloc(capacity);
+  size_t read;
+  while ((read = fread(buf + len, 1, capacity - len, file)) > 0) {
+    len += read;
+    if (len == capacity) {
+      capacity *= 2;
+      buf = realloc(buf, capacity);
+    }
+  }
+  fclose(file);
+  *source = (Source){.data = buf, .len = len, .mapping = NULL};
+  return NULL;
+}
+
+char *source_open(Source *source, const char *path) {
+#ifdef _WIN32
+  return source_read(source, path);
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return "Failed to open file";
+  }
+  struct stat stats;
+  if (fstat(fd, &stats) || !S_ISREG(stats.st_mode) || stats.st_size == 0) {
+    // pipes and empty files can't be mapped
+    close(fd);
+    return source_read(source, path);
+  }
+
+  void *mapping =
+      mmap(NULL, (size_t)stats.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return source_read(source, path);
+  }
+  madvise(mapping, (size_t)stats.st_size, MADV_SEQUENTIAL);
+
+  *source = (Source){
+      .data = mapping, .len = (size_t)stats.st_size, .mapping = mapping};
+  return NULL;
+#endif
+}
+
+void source_close(Source *source) {
+#ifndef _WIN32
+  if (source->mapping) {
+    munmap(source->mapping, source->len);
+    *source = (Source){0};
+    return;
+  }
+#endif
+  free((void *)source->data);
+  *source = (Source){0};
+}
@@ -0,0 +1,17 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+#include <stddef.h>
+
+// Read-only view of an input file, mapped for the whole compilation so
+// tokens can refer back into it without copying.
+typedef struct {
+  const char *data;
+  size_t len;
+  void *mapping; // NULL when the contents were read into a heap buffer
+} Source;
+
+char *source_open(Source *source, const char *path);
+
+void source_close(Source *source);
+
+#endif
@@ -1,55 +1,72 @@
 #ifndef TOKENISER_H
 #define TOKENISER_H
 
+#include "arena.h"
+#include "intern.h"
 #include "operator.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
-typedef struct Token Token;
-typedef struct TokenVec TokenVec;
-typedef struct ParensToken ParensToken;
-typedef struct BlockToken BlockToken;
+typedef struct TokenStream TokenStream;
+typedef union TokenValue TokenValue;
 
-struct TokenVec {
-  int capacity;
-  int length;
-  Token *tokens;
-};
+typedef enum {
+  TT_INT,
+  TT_FLOAT,
+  TT_LONG,   // i64 literal
+  TT_DOUBLE, // f64 literal
+  TT_OP,
+  TT_NAME,
+  TT_COLON,
+  TT_OPEN_PARENS,
+  TT_CLOSE_PARENS,
+  TT_OPEN_BLOCK,
+  TT_CLOSE_BLOCK,
+  TT_COMMA,     // only emitted directly inside parens
+  TT_SEMICOLON, // only emitted directly inside blocks or at the top level
+} TokenKind;
 
-struct ParensToken {
-  TokenVec *args;
-  int argc;
+union TokenValue {
+  int _int;
+  float _float;
+  int64_t _long;
+  double _double;
+  Operator op;
+  Atom name;
+  // brackets and separators: match is the partner bracket of an open or
+  // close, next is the following separator or close at the same depth
+  struct {
+    int match;
+    int next;
+  } group;
 };
 
-struct BlockToken {
-  TokenVec *stmts;
-  int stmtc;
-  bool returns;
-};
+// Location of a token's text in the source buffer.
+typedef struct {
+  unsigned int offset;
+  unsigned int length;
+} Span;
 
-struct Token {
-  enum {
-    TT_INT,
-    TT_FLOAT,
-    TT_OP,
-    TT_NAME,
-    TT_PARENS,
-    TT_BLOCK,
-    TT_COLON,
-  } type;
-  union {
-    int _int;
-    float _float;
-    Operator op;
-    char *name;
-    ParensToken *parens;
-    BlockToken *block;
-  } value;
+// One flat token array for the whole source, stored as parallel kind,
+// payload and span arrays. Nested parens and blocks are index ranges into
+// it. Spans point into source, which must outlive the stream.
+struct TokenStream {
+  const char *source;
+  unsigned char *kinds;
+  TokenValue *values;
+  Span *spans;
+  int length;
+  int capacity;
 };
 
-void append_token(TokenVec *vec, Token token);
-Token copy_token(Token token);
-void print_token(Token token);
-void free_token(Token token);
-TokenVec tokenize(char *buf, size_t len);
-#endif
\ No newline at end of file
+// Half-open range [begin, end) of token indices.
+typedef struct {
+  int begin;
+  int end;
+} TokenSlice;
+
+void print_token(TokenStream *tokens, int i);
+
+char *tokenize(TokenStream *out, const char *buf, size_t len, Arena *arena);
+#endif
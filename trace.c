@@ -0,0 +1,246 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "memtracker.h"
+#include "trace.h"
+
+#define TRACE_MAX_DEPTH 64
+#define TRACE_MAX_COUNTERS 16
+
+typedef struct {
+  const char *name;
+  const char *detail;
+  double start;   // wall clock, ns since trace_enable
+  double wall;    // ns
+  double cpu;     // ns of this thread's CPU time
+  int thread;
+} TraceEvent;
+
+typedef struct {
+  const char *name;
+  long value;
+} TraceCounter;
+
+typedef struct {
+  const char *name;
+  const char *detail;
+  double start;
+  double cpuStart;
+} OpenSpan;
+
+static bool enabled = false;
+static double origin;
+static unsigned long allocationsBefore;
+static atomic_int nextThread = 1;
+
+// Guards events and counters; spans in progress are per thread.
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+static TraceEvent *events = NULL;
+static int eventCount = 0;
+static int eventCapacity = 0;
+static TraceCounter counters[TRACE_MAX_COUNTERS];
+static int counterCount = 0;
+
+static _Thread_local OpenSpan openSpans[TRACE_MAX_DEPTH];
+static _Thread_local int depth = 0;
+static _Thread_local int threadId = 0;
+
+static double clock_ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void trace_enable(void) {
+  enabled = true;
+  origin = clock_ns(CLOCK_MONOTONIC);
+  allocationsBefore = allocation_count();
+}
+
+bool tracing(void) { return enabled; }
+
+void trace_begin(const char *name, const char *detail) {
+  if (!enabled) {
+    return;
+  }
+  // spans past the limit are dropped, but still balanced by trace_end
+  if (depth < TRACE_MAX_DEPTH) {
+    openSpans[depth] = (OpenSpan){
+        .name = name,
+        .detail = detail,
+        .start = clock_ns(CLOCK_MONOTONIC) - origin,
+        .cpuStart = clock_ns(CLOCK_THREAD_CPUTIME_ID)};
+  }
+  depth++;
+}
+
+void trace_end(void) {
+  if (!enabled || depth == 0) {
+    return;
+  }
+  depth--;
+  if (depth >= TRACE_MAX_DEPTH) {
+    return;
+  }
+  OpenSpan *span = &openSpans[depth];
+  if (!threadId) {
+    threadId = atomic_fetch_add(&nextThread, 1);
+  }
+  TraceEvent event = {
+      .name = span->name,
+      .detail = span->detail,
+      .start = span->start,
+      .wall = clock_ns(CLOCK_MONOTONIC) - origin - span->start,
+      .cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID) - span->cpuStart,
+      .thread = threadId};
+
+  pthread_mutex_lock(&traceLock);
+  if (eventCount == eventCapacity) {
+    eventCapacity = (eventCapacity + 1) * 2;
+    events = realloc(events, sizeof(TraceEvent) * eventCapacity);
+  }
+  events[eventCount++] = event;
+  pthread_mutex_unlock(&traceLock);
+}
+
+void trace_count(const char *name, long value) {
+  if (!enabled) {
+    return;
+  }
+  pthread_mutex_lock(&traceLock);
+  int i = 0;
+  while (i < counterCount && strcmp(counters[i].name, name) != 0) {
+    i++;
+  }
+  if (i == counterCount && counterCount < TRACE_MAX_COUNTERS) {
+    counters[counterCount++] = (TraceCounter){.name = name};
+  }
+  if (i < counterCount) {
+    counters[i].value += value;
+  }
+  pthread_mutex_unlock(&traceLock);
+}
+
+void trace_report(FILE *out) {
+  pthread_mutex_lock(&traceLock);
+  // events are recorded as spans end, so order by start to list the
+  // phases in the order they ran
+  int *order = malloc(sizeof(int) * (eventCount + 1));
+  int names = 0;
+  for (int i = 0; i < eventCount; i++) {
+    int j = 0;
+    while (j < names && strcmp(events[order[j]].name, events[i].name) != 0) {
+      j++;
+    }
+    if (j == names) {
+      order[names++] = i;
+    } else if (events[i].start < events[order[j]].start) {
+      order[j] = i;
+    }
+  }
+  for (int i = 1; i < names; i++) {
+    for (int j = i; j > 0 && events[order[j]].start < events[order[j - 1]].start;
+         j--) {
+      int swap = order[j];
+      order[j] = order[j - 1];
+      order[j - 1] = swap;
+    }
+  }
+
+  fprintf(out, "%-16s %8s %12s %12s\n", "phase", "spans", "wall ms",
+          "cpu ms");
+  for (int i = 0; i < names; i++) {
+    const char *name = events[order[i]].name;
+    int spans = 0;
+    double wall = 0, cpu = 0;
+    for (int j = 0; j < eventCount; j++) {
+      if (strcmp(events[j].name, name) == 0) {
+        spans++;
+        wall += events[j].wall;
+        cpu += events[j].cpu;
+      }
+    }
+    fprintf(out, "%-16s %8d %12.3f %12.3f\n", name, spans, wall / 1e6,
+            cpu / 1e6);
+  }
+  free(order);
+
+  for (int i = 0; i < counterCount; i++) {
+    fprintf(out, "%-16s %12ld\n", counters[i].name, counters[i].value);
+  }
+  fprintf(out, "%-16s %12lu\n", "allocations",
+          allocation_count() - allocationsBefore);
+  pthread_mutex_unlock(&traceLock);
+}
+
+static void write_json_string(FILE *file, const char *str) {
+  fputc('"', file);
+  for (; *str; str++) {
+    if (*str == '"' || *str == '\\') {
+      fputc('\\', file);
+    }
+    if ((unsigned char)*str < 0x20) {
+      fprintf(file, "\\u%04x", *str);
+    } else {
+      fputc(*str, file);
+    }
+  }
+  fputc('"', file);
+}
+
+char *trace_write(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    return "Failed to open the trace file";
+  }
+  pthread_mutex_lock(&traceLock);
+  // complete ("X") events in microseconds; viewers nest them by time
+  fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+  double end = 0;
+  for (int i = 0; i < eventCount; i++) {
+    TraceEvent *event = &events[i];
+    fprintf(file, "%s\n  {\"name\": ", i ? "," : "");
+    write_json_string(file, event->name);
+    fprintf(file,
+            ", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, "
+            "\"dur\": %.3f, \"args\": {\"cpu_ms\": %.3f",
+            event->thread, event->start / 1e3, event->wall / 1e3,
+            event->cpu / 1e6);
+    if (event->detail) {
+      fprintf(file, ", \"detail\": ");
+      write_json_string(file, event->detail);
+    }
+    fprintf(file, "}}");
+    if (event->start + event->wall > end) {
+      end = event->start + event->wall;
+    }
+  }
+  for (int i = 0; i < counterCount; i++) {
+    fprintf(file, "%s\n  {\"name\": ", eventCount + i ? "," : "");
+    write_json_string(file, counters[i].name);
+    fprintf(file,
+            ", \"ph\": \"C\", \"pid\": 1, \"ts\": %.3f, "
+            "\"args\": {\"value\": %ld}}",
+            end / 1e3, counters[i].value);
+  }
+  fprintf(file, "\n]}\n");
+  pthread_mutex_unlock(&traceLock);
+  if (fclose(file) != 0) {
+    return "Failed to write the trace file";
+  }
+  return NULL;
+}
+
+void trace_free(void) {
+  free(events);
+  events = NULL;
+  eventCount = 0;
+  eventCapacity = 0;
+  counterCount = 0;
+  enabled = false;
+}
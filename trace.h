@@ -0,0 +1,31 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <stdbool.h>
+#include <stdio.h>
+
+// Wall and CPU time of nested spans, plus named counters. Everything is a
+// no-op until trace_enable, so the calls can stay in the pipeline. Thread
+// safe; each thread nests its own spans.
+void trace_enable(void);
+
+bool tracing(void);
+
+// detail may be NULL; it is shown in the trace but not used for grouping.
+// Both strings must outlive trace_write.
+void trace_begin(const char *name, const char *detail);
+
+void trace_end(void);
+
+void trace_count(const char *name, long value);
+
+// Prints total wall and CPU time per span name in order of first use, then
+// the counters and the number of allocations made while enabled.
+void trace_report(FILE *out);
+
+// Writes every span as a Chrome trace event, loadable in about:tracing or
+// Perfetto.
+char *trace_write(const char *path);
+
+void trace_free(void);
+
+#endif
@@ -3,70 +3,241 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
+#include "intern.h"
 #include "memtracker.h"
+#include "scope.h"
 
-Type parse_type(char *name) {
-  if (strcmp(name, "i32")) {
+Type parse_type(Atom name) {
+  switch (name) {
+  case ATOM_I32:
     return (Type){.type = TYPE_I32};
-  } else if (strcmp(name, "f32")) {
+  case ATOM_F32:
     return (Type){.type = TYPE_F32};
+  case ATOM_I64:
+    return (Type){.type = TYPE_I64};
+  case ATOM_F64:
+    return (Type){.type = TYPE_F64};
+  default:
+    return (Type){.type = TYPE_NULL};
   }
+}
+
+static const Type nullType = {.type = TYPE_NULL};
+static const Type i32Type = {.type = TYPE_I32};
+static const Type f32Type = {.type = TYPE_F32};
+static const Type i64Type = {.type = TYPE_I64};
+static const Type f64Type = {.type = TYPE_F64};
 
-  return (Type){.type = TYPE_NULL};
+// Scalar types share one static instance; anything else is copied into the
+// arena so the cached pointer stays valid after the scope is gone.
+static const Type *stable_type(Type type, Arena *arena) {
+  switch (type.type) {
+  case TYPE_NULL:
+    return &nullType;
+  case TYPE_I32:
+    return &i32Type;
+  case TYPE_F32:
+    return &f32Type;
+  case TYPE_I64:
+    return &i64Type;
+  case TYPE_F64:
+    return &f64Type;
+  case TYPE_FUNC:
+    break;
+  }
+  Type *copy = arena_alloc(arena, sizeof(Type));
+  *copy = type;
+  return copy;
 }
 
-Type infer_type(Expr expr, Name *names, size_t namec) {
-  switch (expr.type) {
-  case EXPR_OP: // TEMP!!
-    return infer_type(expr.value.op->left, names, namec);
-  case EXPR_CALL:
-    return infer_type(expr.value.call->func.value.func->body, names, namec);
-  case EXPR_FUNC: {
-    struct Type *rt = malloc(sizeof(Type));
-    Type *arg_types = malloc(sizeof(Type) * expr.value.func->argc);
-    for (size_t i = 0; i < expr.value.func->argc; i++) {
-      arg_types[i] = parse_type(expr.value.func->args[i].type);
+static char *resolve(Expr *expr, Scope *scope, const Type **out,
+                     Arena *arena) {
+  char *error;
+  switch (expr->type) {
+  case EXPR_OP: {
+    const Type *left, *right;
+    if ((error = annotate_types(&expr->value.op->left, scope, &left, arena)) ||
+        (error =
+             annotate_types(&expr->value.op->right, scope, &right, arena))) {
+      return error;
+    }
+    if (left->type != right->type) {
+      return "Mismatched operand types";
     }
-    return (Type){.type = TYPE_FUNC,
-                  .value.funcType = {
-                      .returnType = rt,
-                  }};
+    *out = left;
+    return NULL;
   }
-  case EXPR_NULL: {
-    return (Type){.type = TYPE_NULL};
+  case EXPR_CALL: {
+    CallExpr *call = expr->value.call;
+    const Type *type;
+    for (int i = 0; i < call->argc; i++) {
+      if ((error = annotate_types(&call->args[i], scope, &type, arena))) {
+        return error;
+      }
+    }
+    if ((error = annotate_types(&call->func, scope, &type, arena))) {
+      return error;
+    }
+    *out = type->type == TYPE_FUNC ? type->value.funcType.returnType
+                                   : &nullType;
+    return NULL;
+  }
+  case EXPR_FUNC: {
+    FuncExpr *func = expr->value.func;
+    Type *type = arena_alloc(arena, sizeof(Type));
+    Type *arg_types = arena_alloc(arena, sizeof(Type) * func->argc);
+    Scope params = {.parent = scope};
+    for (int i = 0; i < func->argc; i++) {
+      arg_types[i] = parse_type(func->args[i].type);
+      scope_define(&params, func->args[i].name, arg_types[i], arena);
+    }
+    const Type *body;
+    if ((error = annotate_types(&func->body, &params, &body, arena))) {
+      return error;
+    }
+    *type = (Type){.type = TYPE_FUNC,
+                   .value.funcType = {
+                       .returnType = (Type *)body,
+                       .args = arg_types,
+                       .argc = func->argc,
+                   }};
+    *out = type;
+    return NULL;
   }
+  case EXPR_NULL:
+    *out = &nullType;
+    return NULL;
   case EXPR_INT:
-    return (Type){.type = TYPE_I32};
-
+    *out = &i32Type;
+    return NULL;
   case EXPR_FLOAT:
-    return (Type){.type = TYPE_F32};
+    *out = &f32Type;
+    return NULL;
+  case EXPR_LONG:
+    *out = &i64Type;
+    return NULL;
+  case EXPR_DOUBLE:
+    *out = &f64Type;
+    return NULL;
   case EXPR_NAME: {
-    for (size_t i = 0; i < namec; i++) {
-      if (names[i].name == expr.value.name) {
-        return names[i].type;
-      }
-    }
-    return (Type){.type = TYPE_NULL};
+    Name *name = scope_lookup(scope, expr->value.name);
+    *out = name ? stable_type(name->type, arena) : &nullType;
+    return NULL;
   }
   case EXPR_BLOCK: {
-    if (expr.value.block->returns) {
-      return infer_type(expr.value.block->stmts[expr.value.block->stmtc - 1],
-                        names, namec);
+    BlockExpr *block = expr->value.block;
+    const Type *last = &nullType;
+    for (int i = 0; i < block->stmtc; i++) {
+      if ((error = annotate_types(&block->stmts[i], scope, &last, arena))) {
+        return error;
+      }
     }
+    *out = block->returns ? last : &nullType;
+    return NULL;
   }
   }
-  return (Type){.type = TYPE_NULL};
+  *out = &nullType;
+  return NULL;
 }
 
-void free_type(Type type) {
-  switch (type.type) {
-  case TYPE_FUNC: {
-    free_type(*type.value.funcType.returnType);
-    for (size_t i = 0; i < type.value.funcType.argc; i++) {
-      free_type(type.value.funcType.args[i]);
+char *annotate_types(Expr *expr, Scope *scope, const Type **type,
+                     Arena *arena) {
+  if (!expr->resolved) {
+    const Type *resolved;
+    char *error = resolve(expr, scope, &resolved, arena);
+    if (error) {
+      return error;
     }
-    free(type.value.funcType.args);
-    free(type.value.funcType.args);
+    expr->resolved = resolved;
+  }
+  *type = expr->resolved;
+  return NULL;
+}
+
+// The function literal node evaluates to, or NODE_NONE when it isn't one
+// the types can see through. Children come before their parents, so the
+// values of node's children are already in values.
+static NodeId function_value(const Ast *ast, const NodeId *values,
+                             NodeId node) {
+  switch (ast->kinds[node]) {
+  case NODE_FUNC:
+    return node;
+  case NODE_OP:
+    // an operation has the type of its left operand
+    return values[ast->lhs[node]];
+  case NODE_BLOCK: {
+    const uint32_t *stmts = ast_list(ast, node);
+    if (!ast->ops[node] || stmts[0] == 0) {
+      return NODE_NONE;
+    }
+    return values[stmts[stmts[0]]];
+  }
+  case NODE_CALL: {
+    NodeId callee = values[ast->lhs[node]];
+    return callee == NODE_NONE ? NODE_NONE : values[ast->lhs[callee]];
   }
+  default:
+    return NODE_NONE;
   }
-}
\ No newline at end of file
+}
+
+char *annotate_ast_types(Ast *ast) {
+  uint8_t *types = ast->types;
+  // function_value of every node so far, so a chain of calls is followed
+  // once rather than again from each call in it
+  NodeId *values = malloc(sizeof(NodeId) * (ast->count + 1));
+  char *error = NULL;
+  for (NodeId node = 0; node < ast->count && !error; node++) {
+    values[node] = function_value(ast, values, node);
+    switch (ast->kinds[node]) {
+    case NODE_NULL:
+      types[node] = TYPE_NULL;
+      break;
+    case NODE_INT:
+      types[node] = TYPE_I32;
+      break;
+    case NODE_FLOAT:
+      types[node] = TYPE_F32;
+      break;
+    case NODE_LONG:
+      types[node] = TYPE_I64;
+      break;
+    case NODE_DOUBLE:
+      types[node] = TYPE_F64;
+      break;
+    case NODE_NAME:
+      // resolved from the binding by ast_build
+      if (ast->rhs[node] == NODE_NONE) {
+        error = "Unbound name";
+      } else if (ast->ops[node] == TYPE_NULL) {
+        error = "Name has no type";
+      }
+      types[node] = ast->ops[node];
+      break;
+    case NODE_OP:
+      if (types[ast->lhs[node]] != types[ast->rhs[node]]) {
+        error = "Mismatched operand types";
+      }
+      types[node] = types[ast->lhs[node]];
+      break;
+    case NODE_CALL: {
+      NodeId callee = values[ast->lhs[node]];
+      types[node] =
+          callee == NODE_NONE ? TYPE_NULL : types[ast->lhs[callee]];
+      break;
+    }
+    case NODE_BLOCK: {
+      const uint32_t *stmts = ast_list(ast, node);
+      types[node] =
+          ast->ops[node] && stmts[0] ? types[stmts[stmts[0]]] : TYPE_NULL;
+      break;
+    }
+    case NODE_FUNC:
+      types[node] = TYPE_FUNC;
+      break;
+    }
+  }
+  free(values);
+  return error;
+}
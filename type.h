@@ -1,13 +1,16 @@
 #ifndef TYPE_H
 #define TYPE_H
 
+#include "arena.h"
+#include "ast.h"
+#include "intern.h"
 #include "parser.h"
 #include <stddef.h>
 
 typedef struct Type Type;
 
 struct Type {
-  enum { TYPE_NULL, TYPE_I32, TYPE_F32, TYPE_FUNC } type;
+  enum { TYPE_NULL, TYPE_I32, TYPE_F32, TYPE_I64, TYPE_F64, TYPE_FUNC } type;
   union {
     struct FuncType {
       struct Type *returnType;
@@ -18,14 +21,25 @@ struct Type {
 };
 
 typedef struct {
-  char *name;
+  Atom name;
   Type type;
 } Name;
 
-Type infer_type(Expr expr, Name *names, size_t namec);
+typedef struct Scope Scope;
 
-void free_type(Type type);
+// Resolves the type of every node under expr in one walk and caches it in
+// each node's resolved field, which later passes read instead of inferring.
+// Operations whose operands have different types are rejected.
+char *annotate_types(Expr *expr, Scope *scope, const Type **type,
+                     Arena *arena);
 
-Type parse_type(char *in);
+// The same rules over an Ast in one forward sweep, storing the kind of each
+// node's type in ast->types. Functions are only TYPE_FUNC there; the result
+// of a call is its callee's body. Unbound and untyped names are rejected
+// too, since nothing compiled can use them.
+char *annotate_ast_types(Ast *ast);
+
+// Maps a type name to its type without interning, so it never locks.
+Type parse_type(Atom name);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,417 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena.h"
+#include "ast.h"
+#include "compiler.h"
+#include "fold.h"
+#include "memtracker.h"
+#include "module.h"
+#include "parser.h"
+#include "sink.h"
+#include "source.h"
+#include "tokeniser.h"
+#include "type.h"
+#include "watch.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Incremental updates allocate into the same arena, so it is rebuilt from
+// scratch every so often to drop the replaced tokens and trees.
+#define COMPACT_INTERVAL 64
+
+// Everything kept alive between saves.
+typedef struct {
+  Arena arena;
+  char *text; // copy of the file the tokens point into
+  size_t len;
+  TokenStream tokens;
+  Module module;
+  bool valid; // tokens and module describe text, so edits can be patched in
+  int updates;
+  int relexed;        // tokens produced by the last update
+  int recompiled;     // definitions compiled by the last update
+  const char *failed; // name of the definition the last update failed in
+} Workspace;
+
+// A top level item: its tokens and the bytes between its separators.
+typedef struct {
+  TokenSlice tokens;
+  size_t start;
+  size_t end;
+} Item;
+
+static int top_level_items(TokenStream *tokens, size_t len, Item **items,
+                           Arena *arena) {
+  int count = 0;
+  int capacity = 0;
+  *items = NULL;
+  int begin = 0;
+  size_t start = 0;
+  for (int i = 0; i <= tokens->length; i++) {
+    if (i < tokens->length && tokens->kinds[i] != TT_SEMICOLON) {
+      if (tokens->kinds[i] == TT_OPEN_PARENS ||
+          tokens->kinds[i] == TT_OPEN_BLOCK) {
+        i = tokens->values[i].group.match;
+      }
+      continue;
+    }
+    if (count == capacity) {
+      int oldCapacity = capacity;
+      capacity = (capacity + 1) * 2;
+      *items = arena_realloc(arena, *items, oldCapacity * sizeof(Item),
+                             capacity * sizeof(Item));
+    }
+    size_t end = i < tokens->length ? tokens->spans[i].offset : len;
+    (*items)[count++] = (Item){.tokens = {begin, i}, .start = start, .end = end};
+    begin = i + 1;
+    start = end + 1;
+  }
+  return count;
+}
+
+static char *write_output(Workspace *ws, int jobs) {
+  OutputSink sink;
+  if (sink_open(&sink, "out.ll")) {
+    return "Failed to open out.ll";
+  }
+  ws->recompiled = 0;
+  for (int i = 0; i < ws->module.count; i++) {
+    ws->recompiled += ws->module.defs[i].impl == NULL;
+  }
+  int failed;
+  char *error = compile_module(&sink.decl, &sink.body, &ws->module, jobs,
+                               &failed, &ws->arena);
+  if (error) {
+    sink_discard(&sink);
+    ws->failed = atom_name(ws->module.defs[failed].name);
+    return error;
+  }
+  return sink_close(&sink);
+}
+
+// Compiles a file holding a single expression, which has no definitions to
+// reuse.
+static char *build_expression(Workspace *ws, bool shared) {
+  Expr expr = {.type = EXPR_NULL};
+  int end = ws->tokens.length;
+  if (end > 0 && ws->tokens.kinds[end - 1] == TT_SEMICOLON) {
+    end--;
+  }
+  char *error = (shared ? parse_shared : parse)(&expr, &ws->tokens,
+                                                (TokenSlice){0, end},
+                                                &ws->arena);
+  if (error) {
+    return error;
+  }
+  Ast ast;
+  ast_build(&ast, expr, shared, &ws->arena);
+  fold_constants(&ast, &ws->arena);
+  NodeId func = ast_root(&ast);
+  if (ast.kinds[func] != NODE_FUNC) {
+    return "The file is neither a module nor a function";
+  }
+  error = annotate_ast_types(&ast);
+  if (error) {
+    return error;
+  }
+  if (ast.types[ast.lhs[func]] == TYPE_NULL) {
+    return "Can't infer the return type of main";
+  }
+  OutputSink sink;
+  if (sink_open(&sink, "out.ll")) {
+    return "Failed to open out.ll";
+  }
+  error = compile_function(&sink.body, &ast, func, "main", &ws->arena);
+  if (error) {
+    sink_discard(&sink);
+    return error;
+  }
+  ws->recompiled = 1;
+  return sink_close(&sink);
+}
+
+// Takes ownership of text.
+static char *full_build(Workspace *ws, char *text, size_t len, int jobs,
+                        bool shared) {
+  arena_free(&ws->arena);
+  free(ws->text);
+  *ws = (Workspace){.text = text, .len = len};
+
+  char *error = tokenize(&ws->tokens, text, len, &ws->arena);
+  if (error) {
+    return error;
+  }
+  ws->relexed = ws->tokens.length;
+  if (!is_module(&ws->tokens)) {
+    return build_expression(ws, shared);
+  }
+  error = parse_module(&ws->module, &ws->tokens, shared, &ws->arena);
+  if (error) {
+    return error;
+  }
+  for (int i = 0; i < ws->module.count; i++) {
+    fold_constants(&ws->module.defs[i].ast, &ws->arena);
+  }
+  error = write_output(ws, jobs);
+  ws->valid = error == NULL;
+  return error;
+}
+
+// Patches an edit into the workspace. Only the top level items the edited
+// bytes fall in are re-tokenized and re-parsed, and only their definitions
+// recompiled. Takes ownership of text.
+static char *update(Workspace *ws, char *text, size_t len, int jobs,
+                    bool shared) {
+  size_t prefix = 0;
+  size_t limit = len < ws->len ? len : ws->len;
+  while (prefix < limit && text[prefix] == ws->text[prefix]) {
+    prefix++;
+  }
+  size_t suffix = 0;
+  while (suffix < limit - prefix &&
+         text[len - 1 - suffix] == ws->text[ws->len - 1 - suffix]) {
+    suffix++;
+  }
+  if (prefix == len && len == ws->len) {
+    free(text);
+    ws->relexed = ws->recompiled = 0;
+    return NULL;
+  }
+  size_t editEnd = ws->len - suffix;
+  long delta = (long)len - (long)ws->len;
+
+  Item *items;
+  int itemCount = top_level_items(&ws->tokens, ws->len, &items, &ws->arena);
+  int first = 0;
+  while (items[first].end < prefix) {
+    first++;
+  }
+  int last = itemCount - 1;
+  while (items[last].start > editEnd) {
+    last--;
+  }
+  size_t start = items[first].start;
+  size_t end = items[last].end + delta;
+  int oldBegin = items[first].tokens.begin;
+  int oldEnd = items[last].tokens.end;
+  int defsBefore = 0;
+  int defsReplaced = 0;
+  for (int i = 0; i <= last; i++) {
+    if (items[i].tokens.begin != items[i].tokens.end) {
+      *(i < first ? &defsBefore : &defsReplaced) += 1;
+    }
+  }
+
+  TokenStream region;
+  char *error = tokenize(&region, text + start, end - start, &ws->arena);
+  if (error) {
+    free(text);
+    ws->valid = false;
+    return error;
+  }
+
+  // splice the new tokens in, moving the ones after them along
+  TokenStream *old = &ws->tokens;
+  int shift = region.length - (oldEnd - oldBegin);
+  int length = old->length + shift;
+  TokenStream tokens = {
+      .source = text,
+      .kinds = arena_alloc(&ws->arena, length + 1),
+      .values = arena_alloc(&ws->arena, sizeof(TokenValue) * (length + 1)),
+      .spans = arena_alloc(&ws->arena, sizeof(Span) * (length + 1)),
+      .length = length,
+      .capacity = length + 1};
+  memcpy(tokens.kinds, old->kinds, oldBegin);
+  memcpy(tokens.values, old->values, sizeof(TokenValue) * oldBegin);
+  memcpy(tokens.spans, old->spans, sizeof(Span) * oldBegin);
+  for (int i = 0; i < region.length; i++) {
+    TokenValue value = region.values[i];
+    TokenKind kind = region.kinds[i];
+    if (kind >= TT_OPEN_PARENS) {
+      value.group.match += value.group.match >= 0 ? oldBegin : 0;
+      value.group.next += value.group.next >= 0 ? oldBegin : 0;
+    }
+    tokens.kinds[oldBegin + i] = kind;
+    tokens.values[oldBegin + i] = value;
+    tokens.spans[oldBegin + i] = (Span){
+        .offset = region.spans[i].offset + (unsigned)start,
+        .length = region.spans[i].length};
+  }
+  for (int i = oldEnd; i < old->length; i++) {
+    TokenValue value = old->values[i];
+    TokenKind kind = old->kinds[i];
+    if (kind >= TT_OPEN_PARENS) {
+      value.group.match += value.group.match >= 0 ? shift : 0;
+      value.group.next += value.group.next >= 0 ? shift : 0;
+    }
+    tokens.kinds[i + shift] = kind;
+    tokens.values[i + shift] = value;
+    tokens.spans[i + shift] =
+        (Span){.offset = (unsigned)(old->spans[i].offset + delta),
+               .length = old->spans[i].length};
+  }
+
+  // untouched definitions keep their trees and generated code
+  Module module = {0};
+  for (int i = 0; i < defsBefore; i++) {
+    module_add(&module, ws->module.defs[i], &ws->arena);
+  }
+  error = parse_definitions(
+      &module, &tokens,
+      (TokenSlice){oldBegin, oldBegin + region.length}, shared, &ws->arena);
+  if (!error) {
+    for (int i = defsBefore; i < module.count; i++) {
+      fold_constants(&module.defs[i].ast, &ws->arena);
+    }
+    for (int i = defsBefore + defsReplaced; i < ws->module.count; i++) {
+      Definition def = ws->module.defs[i];
+      def.tokens.begin += shift;
+      def.tokens.end += shift;
+      module_add(&module, def, &ws->arena);
+    }
+    error = check_module(&module, &ws->arena);
+  }
+  if (error) {
+    free(text);
+    ws->valid = false;
+    return error;
+  }
+
+  free(ws->text);
+  ws->text = text;
+  ws->len = len;
+  ws->tokens = tokens;
+  ws->module = module;
+  ws->relexed = region.length;
+  ws->updates++;
+  error = write_output(ws, jobs);
+  ws->valid = error == NULL;
+  return error;
+}
+
+static char *read_text(const char *path, char **text, size_t *len) {
+  Source source;
+  char *error = source_open(&source, path);
+  if (error) {
+    return error;
+  }
+  *text = malloc(source.len + 1);
+  memcpy(*text, source.data, source.len);
+  *len = source.len;
+  source_close(&source);
+  return NULL;
+}
+
+static double elapsed_ms(struct timespec from, struct timespec to) {
+  return (to.tv_sec - from.tv_sec) * 1e3 + (to.tv_nsec - from.tv_nsec) / 1e6;
+}
+
+static void rebuild(Workspace *ws, const char *path, int jobs, bool shared) {
+  struct timespec begin;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  char *text;
+  size_t len;
+  ws->failed = NULL;
+  char *error = read_text(path, &text, &len);
+  if (!error) {
+    bool incremental = ws->valid && ws->updates < COMPACT_INTERVAL;
+    error = incremental ? update(ws, text, len, jobs, shared)
+                        : full_build(ws, text, len, jobs, shared);
+  }
+  if (error && ws->failed) {
+    fprintf(stderr, "Error in %s: %s\n", ws->failed, error);
+    return;
+  }
+  if (error) {
+    fprintf(stderr, "Error: %s\n", error);
+    return;
+  }
+
+  struct timespec done;
+  clock_gettime(CLOCK_MONOTONIC, &done);
+  printf("Updated out.ll in %.2f ms: %d of %d tokens lexed, %d of %d "
+         "functions compiled",
+         elapsed_ms(begin, done), ws->relexed, ws->tokens.length,
+         ws->recompiled, ws->module.count ? ws->module.count : 1);
+#ifdef __linux__
+  // edit to output, measured from when the file was last written
+  struct stat stats;
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  if (stat(path, &stats) == 0) {
+    printf(", %.2f ms after save", elapsed_ms(stats.st_mtim, now));
+  }
+#endif
+  printf("\n");
+  fflush(stdout);
+}
+
+#ifdef __linux__
+
+char *watch(const char *path, int jobs, bool shared) {
+  // editors often replace the file rather than rewrite it, so watch the
+  // directory and filter on the name
+  const char *slash = strrchr(path, '/');
+  const char *name = slash ? slash + 1 : path;
+  char dir[4096];
+  snprintf(dir, sizeof(dir), "%.*s", slash ? (int)(slash - path) : 1,
+           slash ? path : ".");
+
+  int fd = inotify_init1(IN_CLOEXEC);
+  if (fd < 0) {
+    return "Failed to start inotify";
+  }
+  if (inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) <
+      0) {
+    close(fd);
+    return "Failed to watch the source directory";
+  }
+
+  Workspace ws = {0};
+  rebuild(&ws, path, jobs, shared);
+
+  char events[16 * 1024]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+  for (;;) {
+    bool changed = false;
+    // a save can raise several events; take everything that arrives
+    // together as one change
+    int timeout = -1;
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    while (poll(&pfd, 1, timeout) > 0) {
+      ssize_t n = read(fd, events, sizeof(events));
+      if (n <= 0) {
+        break;
+      }
+      for (char *p = events; p < events + n;) {
+        struct inotify_event *event = (struct inotify_event *)p;
+        if (event->len && strcmp(event->name, name) == 0) {
+          changed = true;
+        }
+        p += sizeof(struct inotify_event) + event->len;
+      }
+      timeout = changed ? 5 : -1;
+    }
+    if (changed) {
+      rebuild(&ws, path, jobs, shared);
+    }
+  }
+}
+
+#else
+
+char *watch(const char *path, int jobs, bool shared) {
+  (void)path, (void)jobs, (void)shared;
+  return "Watch mode needs inotify, which is only available on Linux";
+}
+
+#endif
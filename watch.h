@@ -0,0 +1,11 @@
+#ifndef WATCH_H
+#define WATCH_H
+#include <stdbool.h>
+
+// Recompiles path into out.ll every time it is saved. A module keeps its
+// tokens, trees and generated code between saves, so only the definitions
+// an edit touches are re-tokenized, re-parsed and recompiled. Only returns
+// on failure.
+char *watch(const char *path, int jobs, bool shared);
+
+#endif